@@ -209,6 +209,9 @@ import {
   accuratePow64,
   v128_zero,
   v128_ones,
+  isHighSurrogate,
+  isLowSurrogate,
+  combineSurrogates,
 } from "./util";
 
 import {
@@ -744,6 +747,9 @@ export class Compiler extends DiagnosticEmitter {
     if (hasShadowStack) {
       this.module.addFunctionImport(BuiltinNames.localToStack, BuiltinNames.externalFuncName, BuiltinNames.localToStack, TypeRef.I32, TypeRef.I32);
       this.module.addFunctionImport(BuiltinNames.tmpToStack, BuiltinNames.externalFuncName, BuiltinNames.tmpToStack, TypeRef.I32, TypeRef.I32);
+      this.addManagedParamsSection();
+      // WARPO recognizes runtime functions by name, so binary output keeps the name section
+      this.module.setDebugInfo(true);
     }
     if (program.lookup("ASC_RTRACE") != null) {
       new RtraceMemory(this).walkModule();
@@ -752,6 +758,36 @@ export class Compiler extends DiagnosticEmitter {
     return module;
   }
 
+  /** Records the parameters holding managed references of each compiled function for GC lowering of WARPO. */
+  private addManagedParamsSection(): void {
+    let bytes = new Array<i32>();
+    let instances = this.program.instancesByName;
+    for (let _values = Map_values(instances), i = 0, k = _values.length; i < k; ++i) {
+      let element = unchecked(_values[i]);
+      if (element.kind != ElementKind.Function) continue;
+      let instance = <Function>element;
+      if (instance.ref == 0) continue;
+      let signature = instance.signature;
+      let numParams = signature.parameterTypes.length;
+      if (signature.thisType) ++numParams;
+      let localsByIndex = instance.localsByIndex;
+      let managed = new Array<i32>();
+      for (let j = 0; j < numParams; ++j) {
+        if (localsByIndex[j].type.isManaged) managed.push(j);
+      }
+      writeStringLEB128(bytes, instance.internalName);
+      writeU32LEB128(bytes, managed.length);
+      for (let j = 0, l = managed.length; j < l; ++j) {
+        writeU32LEB128(bytes, managed[j]);
+      }
+    }
+    let contents = new Uint8Array(bytes.length);
+    for (let i = 0, k = bytes.length; i < k; ++i) {
+      contents[i] = <u8>bytes[i];
+    }
+    this.module.addCustomSection("warpo.managed_params", contents);
+  }
+
   private initDefaultMemory(memoryOffset: i64): void {
     this.memoryOffset = memoryOffset;
 
@@ -10514,6 +10550,46 @@ export class Compiler extends DiagnosticEmitter {
 
 // helpers
 
+/** Appends an unsigned LEB128 encoded integer to the specified bytes. */
+function writeU32LEB128(bytes: i32[], value: i32): void {
+  do {
+    let byte = value & 0x7F;
+    value >>>= 7;
+    if (value != 0) byte |= 0x80;
+    bytes.push(byte);
+  } while (value != 0);
+}
+
+/** Appends a UTF-8 encoded string prefixed with its byte length to the specified bytes. */
+function writeStringLEB128(bytes: i32[], str: string): void {
+  let utf8 = new Array<i32>();
+  for (let i = 0, k = str.length; i < k; ++i) {
+    let c = str.charCodeAt(i);
+    if (isHighSurrogate(c) && i + 1 < k && isLowSurrogate(str.charCodeAt(i + 1))) {
+      c = combineSurrogates(c, str.charCodeAt(++i));
+    }
+    if (c <= 0x7F) {
+      utf8.push(c);
+    } else if (c <= 0x7FF) {
+      utf8.push(0xC0 | (c >>> 6));
+      utf8.push(0x80 | (c & 63));
+    } else if (c <= 0xFFFF) {
+      utf8.push(0xE0 | (c >>> 12));
+      utf8.push(0x80 | ((c >>> 6) & 63));
+      utf8.push(0x80 | (c & 63));
+    } else {
+      utf8.push(0xF0 | (c >>> 18));
+      utf8.push(0x80 | ((c >>> 12) & 63));
+      utf8.push(0x80 | ((c >>> 6) & 63));
+      utf8.push(0x80 | (c & 63));
+    }
+  }
+  writeU32LEB128(bytes, utf8.length);
+  for (let i = 0, k = utf8.length; i < k; ++i) {
+    bytes.push(utf8[i]);
+  }
+}
+
 function mangleImportName(
   element: Element,
   declaration: DeclarationStatement
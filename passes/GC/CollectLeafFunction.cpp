@@ -1,10 +1,16 @@
+#include <map>
 #include <set>
+#include <vector>
 
+#include "../helper/BuildCallGraph.hpp"
+#include "../helper/CFG.hpp"
 #include "CollectLeafFunction.hpp"
 #include "GCInfo.hpp"
 #include "fmt/base.h"
 #include "support/Debug.hpp"
+#include "support/DynBitSet.hpp"
 #include "support/name.h"
+#include "wasm-traversal.h"
 #include "wasm.h"
 
 #define PASS_NAME "GCLeafFunction"
@@ -22,7 +28,7 @@ static LeafFunc collectLeafFunctions(const CallGraph &cg) {
       reservedCallGraph.try_emplace(callee, std::set<wasm::Name>{}).first->second.insert(caller);
     }
   }
-  std::set<wasm::Name> workList{FnNew, FnCollect};
+  std::set<wasm::Name> workList{FnNew, FnCollect, UnknownCallee};
   while (!workList.empty()) {
     auto it = workList.begin();
     if (leaf.erase(*it) == 1) {
@@ -46,12 +52,128 @@ void LeafFunctionCollector::run(wasm::Module *m) {
   }
 }
 
+namespace {
+
+/// @brief basic blocks which are reachable from function entry and reach function exit.
+DynBitset getReturningBlocks(CFG const &cfg) {
+  DynBitset reachable{cfg.size()};
+  DynBitset returning{cfg.size()};
+  std::vector<BasicBlock const *> workList{&cfg[0]};
+  reachable.set(0U, true);
+  while (!workList.empty()) {
+    BasicBlock const *bb = workList.back();
+    workList.pop_back();
+    for (BasicBlock const *succ : bb->succs()) {
+      if (!reachable.get(succ->getIndex())) {
+        reachable.set(succ->getIndex(), true);
+        workList.push_back(succ);
+      }
+    }
+  }
+  for (BasicBlock const &bb : cfg) {
+    if (bb.isExit()) {
+      returning.set(bb.getIndex(), true);
+      workList.push_back(&bb);
+    }
+  }
+  while (!workList.empty()) {
+    BasicBlock const *bb = workList.back();
+    workList.pop_back();
+    for (BasicBlock const *pred : bb->preds()) {
+      if (!returning.get(pred->getIndex())) {
+        returning.set(pred->getIndex(), true);
+        workList.push_back(pred);
+      }
+    }
+  }
+  return reachable & returning;
+}
+
+} // namespace
+
+void MayThrowCollector::run(wasm::Module *m) {
+  struct ThrowFinder : public wasm::PostWalker<ThrowFinder> {
+    bool throws_ = false;
+    bool catches_ = false;
+    void visitThrow(wasm::Throw *) { throws_ = true; }
+    void visitRethrow(wasm::Rethrow *) { throws_ = true; }
+    void visitThrowRef(wasm::ThrowRef *) { throws_ = true; }
+    void visitTry(wasm::Try *) { catches_ = true; }
+    void visitTryTable(wasm::TryTable *) { catches_ = true; }
+  };
+  std::set<wasm::Name> workList{};
+  bool isCatching = false;
+  for (std::unique_ptr<wasm::Function> const &f : m->functions) {
+    if (f->imported())
+      continue;
+    ThrowFinder finder{};
+    finder.walk(f->body);
+    if (finder.throws_)
+      workList.insert(f->name);
+    isCatching |= finder.catches_;
+  }
+  if (isCatching) {
+    // host exceptions are only observable when they can be caught
+    for (std::unique_ptr<wasm::Function> const &f : m->functions) {
+      if (f->imported())
+        workList.insert(f->name);
+    }
+    workList.insert(UnknownCallee);
+  }
+
+  std::map<wasm::Name, std::set<wasm::Name>> reservedCallGraph{};
+  for (auto const &[caller, callees] : *cg_) {
+    for (wasm::Name const &callee : callees)
+      reservedCallGraph[callee].insert(caller);
+  }
+  while (!workList.empty()) {
+    auto it = workList.begin();
+    if (result_->insert(*it).second) {
+      auto const reservedCallGraphIt = reservedCallGraph.find(*it);
+      if (reservedCallGraphIt != reservedCallGraph.end())
+        workList.insert(reservedCallGraphIt->second.begin(), reservedCallGraphIt->second.end());
+    }
+    workList.erase(it);
+  }
+}
+
+void ReturningCallGraphBuilder::runOnFunction(wasm::Module *m, wasm::Function *func) {
+  std::set<wasm::Name> &callees = result_->at(func->name);
+  // callers may catch the exception and resume after a collection on any path
+  bool const isAllCallSites = mayThrow_->contains(func->name);
+  CFG const cfg = CFG::fromFunction(func);
+  DynBitset const returningBlocks = getReturningBlocks(cfg);
+  for (BasicBlock const &bb : cfg) {
+    for (wasm::Expression *expr : bb) {
+      if (auto *call = expr->dynCast<wasm::Call>()) {
+        // tail call returns to the caller from callee
+        if (isAllCallSites || call->isReturn || returningBlocks.get(bb.getIndex()))
+          callees.insert(call->target);
+      } else if (auto *callIndirect = expr->dynCast<wasm::CallIndirect>()) {
+        if (isAllCallSites || callIndirect->isReturn || returningBlocks.get(bb.getIndex())) {
+          std::set<wasm::Name> const targets = indirectCallTargets_->get(*m, callIndirect);
+          callees.insert(targets.begin(), targets.end());
+        }
+      }
+    }
+  }
+  if (support::isDebug(PASS_NAME, func->name.str)) {
+    for (wasm::Name const &callee : callees)
+      fmt::println(DEBUG_PREFIX "'{}' calls '{}' on returning path", func->name.str, callee.str);
+  }
+}
+
 } // namespace warpo::passes::gc
 
 #ifdef WARPO_ENABLE_UNIT_TESTS
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <memory>
+
+#include "../Runner.hpp"
+#include "parser/wat-parser.h"
+#include "pass.h"
 
 namespace warpo::passes::ut {
 
@@ -75,6 +197,82 @@ TEST(GCLeafFunctionTest, LeafFunction) {
   EXPECT_THAT(leaf, Not(Contains("parent_poison")));
 }
 
+TEST(GCLeafFunctionTest, ReturningCallGraph) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (import "env" "abort" (func $abort))
+      (func $~lib/rt/itcms/__new (result i32)
+        i32.const 0
+      )
+      (func $alloc_on_error (param i32) (result i32)
+        (if (local.get 0)
+          (then
+            (drop (call $~lib/rt/itcms/__new))
+            (call $abort)
+            (unreachable)
+          )
+        )
+        (local.get 0)
+      )
+      (func $alloc (param i32) (result i32)
+        (if (local.get 0)
+          (then (drop (call $~lib/rt/itcms/__new)))
+        )
+        (local.get 0)
+      )
+    )
+  )");
+  wasm::PassRunner runner{m.get()};
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets = IndirectCallTargets::create(*m);
+  std::shared_ptr<CallGraph const> fullCG = CallGraphBuilder::addToPass(runner, indirectCallTargets);
+  std::shared_ptr<CallGraph const> cg = ReturningCallGraphBuilder::addToPass(runner, fullCG, indirectCallTargets);
+  std::shared_ptr<LeafFunc> leaf = LeafFunctionCollector::addToPass(runner, cg);
+  runner.run();
+
+  EXPECT_THAT(cg->at("alloc_on_error"), Not(Contains(FnNew)));
+  EXPECT_THAT(cg->at("alloc"), Contains(FnNew));
+  EXPECT_THAT(*leaf, Contains("alloc_on_error"));
+  EXPECT_THAT(*leaf, Not(Contains("alloc")));
+}
+
+TEST(GCLeafFunctionTest, ReturningCallGraphWithThrowingCallee) {
+  // exception handling is not enabled by loadWat
+  wasm::Module m{};
+  m.features = wasm::FeatureSet::All;
+  auto parsed = wasm::WATParser::parseModule(m, R"(
+    (module
+      (tag $e)
+      (func $~lib/rt/itcms/__new (result i32)
+        i32.const 0
+      )
+      (func $throw
+        (throw $e)
+      )
+      (func $alloc_on_throw (param i32) (result i32)
+        (if (local.get 0)
+          (then
+            (drop (call $~lib/rt/itcms/__new))
+            (call $throw)
+            (unreachable)
+          )
+        )
+        (local.get 0)
+      )
+    )
+  )");
+  ASSERT_EQ(parsed.getErr(), nullptr);
+  wasm::PassRunner runner{&m};
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets = IndirectCallTargets::create(m);
+  std::shared_ptr<CallGraph const> fullCG = CallGraphBuilder::addToPass(runner, indirectCallTargets);
+  std::shared_ptr<CallGraph const> cg = ReturningCallGraphBuilder::addToPass(runner, fullCG, indirectCallTargets);
+  std::shared_ptr<LeafFunc> leaf = LeafFunctionCollector::addToPass(runner, cg);
+  runner.run();
+
+  // callers of alloc_on_throw may catch the exception after the allocation
+  EXPECT_THAT(cg->at("alloc_on_throw"), Contains(FnNew));
+  EXPECT_THAT(*leaf, Not(Contains("alloc_on_throw")));
+}
+
 } // namespace warpo::passes::ut
 
 #endif
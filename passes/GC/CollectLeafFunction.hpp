@@ -12,6 +12,7 @@ namespace warpo::passes::gc {
 
 struct LeafFunc : public std::set<wasm::Name> {};
 /// @brief collect GC leaf functions, i.e., functions that do not call __new / __collect function.
+/// @details UnknownCallee is never a leaf function.
 struct LeafFunctionCollector : public wasm::Pass {
   std::shared_ptr<CallGraph const> const cg_;
   std::shared_ptr<LeafFunc> const result_;
@@ -29,4 +30,58 @@ struct LeafFunctionCollector : public wasm::Pass {
   }
 };
 
+struct MayThrowFunc : public std::set<wasm::Name> {};
+/// @brief collect functions which may throw, i.e. functions which throw by themselves or call such functions.
+/// @details when the module catches exceptions, imported functions and UnknownCallee may throw as well.
+struct MayThrowCollector : public wasm::Pass {
+  std::shared_ptr<CallGraph const> const cg_;
+  std::shared_ptr<MayThrowFunc> const result_;
+  MayThrowCollector(std::shared_ptr<CallGraph const> const &cg, std::shared_ptr<MayThrowFunc> const &result)
+      : cg_(cg), result_(result) {
+    name = "MayThrowCollector";
+  }
+  bool modifiesBinaryenIR() override { return false; }
+  void run(wasm::Module *m) override;
+
+  static std::shared_ptr<MayThrowFunc const> addToPass(wasm::PassRunner &runner,
+                                                       std::shared_ptr<CallGraph const> const &cg) {
+    auto result = std::make_shared<MayThrowFunc>();
+    runner.add(std::unique_ptr<wasm::Pass>(new MayThrowCollector(cg, result)));
+    return result;
+  }
+};
+
+/// @brief call graph which only contains call sites on paths returning to the caller.
+/// @details a collection on a path which traps or never returns is not observed by callers, since their frames are
+/// never resumed. Leaf functions collected from this graph may still collect, but never return afterwards. Functions
+/// which may throw, directly or through their callees, keep all call sites.
+struct ReturningCallGraphBuilder : public wasm::Pass {
+  std::shared_ptr<CallGraph> const result_;
+  std::shared_ptr<IndirectCallTargets const> const indirectCallTargets_;
+  std::shared_ptr<MayThrowFunc const> const mayThrow_;
+  ReturningCallGraphBuilder(std::shared_ptr<CallGraph> const &result,
+                            std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
+                            std::shared_ptr<MayThrowFunc const> const &mayThrow)
+      : result_(result), indirectCallTargets_(indirectCallTargets), mayThrow_(mayThrow) {
+    name = "ReturningCallGraphBuilder";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<ReturningCallGraphBuilder>(result_, indirectCallTargets_, mayThrow_);
+  }
+  bool modifiesBinaryenIR() override { return false; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override;
+
+  /// @param cg full call graph, it is used to find functions which may throw.
+  static std::shared_ptr<CallGraph const>
+  addToPass(wasm::PassRunner &runner, std::shared_ptr<CallGraph const> const &cg,
+            std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets) {
+    std::shared_ptr<MayThrowFunc const> mayThrow = MayThrowCollector::addToPass(runner, cg);
+    auto result =
+        std::make_shared<CallGraph>(CallGraphBuilder::createResults(*runner.wasm, *indirectCallTargets));
+    runner.add(std::unique_ptr<wasm::Pass>(new ReturningCallGraphBuilder(result, indirectCallTargets, mayThrow)));
+    return result;
+  }
+};
+
 } // namespace warpo::passes::gc
\ No newline at end of file
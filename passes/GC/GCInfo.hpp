@@ -5,6 +5,13 @@ namespace warpo::passes::gc {
 constexpr const char *FnLocalToStack = "~lib/rt/__localtostack";
 constexpr const char *FnTmpToStack = "~lib/rt/__tmptostack";
 
+constexpr const char *FnDecreaseSP = "~lib/rt/__decrease_sp";
+constexpr const char *FnDecreaseSPWithoutFill = "~lib/rt/__decrease_sp_without_fill";
+constexpr const char *FnDecreaseSPWithoutCheck = "~lib/rt/__decrease_sp_without_check";
+constexpr const char *FnDecreaseSPWithoutFillAndCheck = "~lib/rt/__decrease_sp_without_fill_and_check";
+constexpr const char *FnIncreaseSP = "~lib/rt/__increase_sp";
+constexpr const char *FnCheckStack = "~lib/rt/__check_stack";
+
 constexpr const char *FnNew = "~lib/rt/itcms/__new";
 constexpr const char *FnCollect = "~lib/rt/itcms/__collect";
 
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "CollectLeafFunction.hpp"
+#include "GCInfo.hpp"
+#include "LazyRootSpilling.hpp"
+#include "StackAssigner.hpp"
+#include "fmt/base.h"
+#include "ir/branch-utils.h"
+#include "ir/parents.h"
+#include "support/Debug.hpp"
+#include "wasm-builder.h"
+#include "wasm-traversal.h"
+#include "wasm.h"
+
+#define PASS_NAME "LazyRootSpilling"
+#define DEBUG_PREFIX "[LazyRootSpilling] "
+
+namespace warpo::passes::gc {
+
+namespace {
+
+bool isShadowStackHelper(wasm::Name const &target) {
+  return target == FnDecreaseSP || target == FnDecreaseSPWithoutFill || target == FnDecreaseSPWithoutCheck ||
+         target == FnDecreaseSPWithoutFillAndCheck || target == FnIncreaseSP || target == FnCheckStack;
+}
+
+size_t getItemIndex(wasm::Block *block, wasm::Expression *item) {
+  return static_cast<size_t>(std::find(block->list.begin(), block->list.end(), item) - block->list.begin());
+}
+
+/// @brief sink the store of one spilled local through structured control flow.
+/// @details the store moves over block items which neither collect, branch out, change the local nor touch the slot.
+/// It is split into both arms of `if`, dropped on paths which trap, return or release the frame before any
+/// collection, and only leaves a block when the end of the block is reached through the original store.
+class RootStoreSinker {
+  wasm::Builder b_;
+  StackPosition &stackPosition_;
+  LeafFunc const *leaf_;
+  wasm::Parents const &parents_;
+  std::map<wasm::LocalSet *, uint32_t> const &spilledSets_;
+  uint32_t offset_;
+  wasm::Index local_;
+  wasm::Name target_;
+
+  enum class Result { Placed, ReachedEnd };
+
+public:
+  size_t storeCount_ = 0U;
+
+  RootStoreSinker(wasm::Module &m, StackPosition &stackPosition, LeafFunc const *leaf, wasm::Parents const &parents,
+                  std::map<wasm::LocalSet *, uint32_t> const &spilledSets, wasm::Call *store, wasm::Index local)
+      : b_(m), stackPosition_(stackPosition), leaf_(leaf), parents_(parents), spilledSets_(spilledSets),
+        offset_(stackPosition.find(store)->second), local_(local), target_(store->target) {}
+
+  void sink(wasm::Block *block, size_t index) {
+    wasm::Block *current = block;
+    size_t next = index;
+    while (sinkInBlock(current, next) == Result::ReachedEnd) {
+      // end of unnamed block is only reached by falling through from the original store
+      wasm::Expression *child = current;
+      wasm::Expression *parent = current->name.is() ? nullptr : parents_.getParent(current);
+      if (parent != nullptr && parent->is<wasm::Loop>()) {
+        child = parent;
+        parent = parents_.getParent(parent);
+      }
+      auto *const parentBlock = parent == nullptr ? nullptr : parent->dynCast<wasm::Block>();
+      if (parentBlock == nullptr) {
+        current->list.push_back(makeStore());
+        return;
+      }
+      current = parentBlock;
+      next = getItemIndex(parentBlock, child) + 1U;
+    }
+  }
+
+private:
+  wasm::Expression *makeStore() {
+    wasm::Call *const call = b_.makeCall(target_, {b_.makeLocalGet(local_, wasm::Type::i32)}, wasm::Type::i32);
+    stackPosition_.insert_or_assign(call, offset_);
+    storeCount_++;
+    return b_.makeDrop(call);
+  }
+
+  Result sinkInBlock(wasm::Block *block, size_t index) {
+    for (size_t i = index; i < block->list.size(); i++) {
+      wasm::Expression *const item = block->list[i];
+      if (auto *call = item->dynCast<wasm::Call>(); call != nullptr && call->target == FnIncreaseSP)
+        return Result::Placed;
+      if (auto *iff = item->dynCast<wasm::If>(); iff != nullptr && !isBarrier(iff->condition) &&
+                                                 wasm::BranchUtils::getExitingBranches(iff).empty()) {
+        if (sinkInArms(iff) == Result::Placed)
+          return Result::Placed;
+        continue;
+      }
+      bool const isValueOfBlock = block->type.isConcrete() && i + 1U == block->list.size();
+      if (isValueOfBlock || isBarrier(item) || !wasm::BranchUtils::getExitingBranches(item).empty()) {
+        block->list.insertAt(i, makeStore());
+        return Result::Placed;
+      }
+      if (item->type == wasm::Type::unreachable)
+        return Result::Placed;
+    }
+    return Result::ReachedEnd;
+  }
+
+  Result sinkInArms(wasm::If *iff) {
+    bool isOnlyReachedEnd = true;
+    std::vector<wasm::Block *> reachedEndArms{};
+    for (wasm::Expression **arm : {&iff->ifTrue, &iff->ifFalse}) {
+      if (*arm == nullptr)
+        continue;
+      wasm::Block *const block = b_.blockify(*arm);
+      *arm = block;
+      if (sinkInBlock(block, 0U) == Result::ReachedEnd)
+        reachedEndArms.push_back(block);
+      else if (block->type != wasm::Type::unreachable)
+        isOnlyReachedEnd = false;
+    }
+    // the store after if covers all arms which fall through
+    if (isOnlyReachedEnd)
+      return Result::ReachedEnd;
+    for (wasm::Block *block : reachedEndArms)
+      block->list.push_back(makeStore());
+    if (iff->ifFalse == nullptr)
+      iff->ifFalse = b_.makeBlock({makeStore()});
+    return Result::Placed;
+  }
+
+  bool isBarrier(wasm::Expression *expr) const {
+    struct Scanner : public wasm::PostWalker<Scanner, wasm::UnifiedExpressionVisitor<Scanner>> {
+      RootStoreSinker const &sinker_;
+      bool isBarrier_ = false;
+      explicit Scanner(RootStoreSinker const &sinker) : sinker_(sinker) {}
+      void visitExpression(wasm::Expression *expr) {
+        if (!isBarrier_)
+          isBarrier_ = sinker_.isBarrierExpr(expr);
+      }
+    };
+    Scanner scanner{*this};
+    scanner.walk(expr);
+    return scanner.isBarrier_;
+  }
+
+  bool isBarrierExpr(wasm::Expression *expr) const {
+    if (expr->is<wasm::CallIndirect>() || expr->is<wasm::CallRef>() || expr->is<wasm::Throw>() ||
+        expr->is<wasm::Rethrow>() || expr->is<wasm::ThrowRef>())
+      return true;
+    if (auto *set = expr->dynCast<wasm::LocalSet>()) {
+      auto const it = spilledSets_.find(set);
+      return set->index == local_ || (it != spilledSets_.end() && it->second == offset_);
+    }
+    auto *call = expr->dynCast<wasm::Call>();
+    if (call == nullptr)
+      return false;
+    auto const it = stackPosition_.find(call);
+    if (it != stackPosition_.end())
+      return it->second == offset_;
+    if (isShadowStackHelper(call->target))
+      return false;
+    return call->isReturn || leaf_ == nullptr || !leaf_->contains(call->target);
+  }
+};
+
+} // namespace
+
+void LazyRootSpilling::runOnFunction(wasm::Module *m, wasm::Function *func) {
+  StackPosition &stackPosition = stackPositions_->at(func);
+  if (stackPosition.begin() == stackPosition.end())
+    return;
+  wasm::Parents const parents{func->body};
+  struct SpilledSetCollector : public wasm::PostWalker<SpilledSetCollector> {
+    StackPosition const &stackPosition_;
+    wasm::Parents const &parents_;
+    std::vector<wasm::LocalSet *> sets_{};
+    std::map<wasm::LocalSet *, uint32_t> offsets_{};
+    SpilledSetCollector(StackPosition const &stackPosition, wasm::Parents const &parents)
+        : stackPosition_(stackPosition), parents_(parents) {}
+    void visitLocalSet(wasm::LocalSet *expr) {
+      auto *call = expr->value->dynCast<wasm::Call>();
+      if (expr->isTee() || call == nullptr)
+        return;
+      auto const it = stackPosition_.find(call);
+      wasm::Expression *const parent = parents_.getParent(expr);
+      if (it == stackPosition_.end() || parent == nullptr || !parent->is<wasm::Block>())
+        return;
+      sets_.push_back(expr);
+      offsets_.insert_or_assign(expr, it->second);
+    }
+  };
+  SpilledSetCollector collector{stackPosition, parents};
+  collector.walk(func->body);
+
+  size_t storeCount = 0U;
+  for (wasm::LocalSet *set : collector.sets_) {
+    auto *const store = set->value->cast<wasm::Call>();
+    RootStoreSinker sinker{*m, stackPosition, leaf_.get(), parents, collector.offsets_, store, set->index};
+    set->value = store->operands.front();
+    auto *const block = parents.getParent(set)->cast<wasm::Block>();
+    sinker.sink(block, getItemIndex(block, set) + 1U);
+    storeCount += sinker.storeCount_;
+  }
+
+  if (support::isDebug(PASS_NAME, func->name.str))
+    fmt::println(DEBUG_PREFIX "'{}': sink {} stores to {} stores", func->name.str, collector.sets_.size(), storeCount);
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../helper/ToString.hpp"
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+#include "ir/find_all.h"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+std::unique_ptr<wasm::Module> lowerWithLazyRootSpilling(std::string_view funcWat) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.lazyRootSpilling = true;
+  return lowerGCTestWat(funcWat, config);
+}
+
+} // namespace
+
+TEST(LazyRootSpillingTest, EarlyExitSkipsStore) {
+  std::unique_ptr<wasm::Module> m = lowerWithLazyRootSpilling(R"(
+    (func $f (param i32) (result i32)
+      (local i32)
+      (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (if (local.get 0)
+        (then (return (local.get 1)))
+      )
+      (call $use (call $~lib/rt/itcms/__new) (local.get 1))
+      (local.get 1)
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  std::vector<wasm::If *> const ifs = wasm::FindAll<wasm::If>(f->body).list;
+  ASSERT_EQ(ifs.size(), 1U);
+  EXPECT_EQ(countToStackStores(ifs.front()), 0U);
+  EXPECT_EQ(countToStackStores(f->body), 1U);
+  std::string const str = toString(f);
+  size_t const storeIndex = str.find("__tostack<0>");
+  ASSERT_NE(storeIndex, std::string::npos);
+  EXPECT_EQ(storeIndex, str.rfind("__tostack<0>"));
+  EXPECT_GT(storeIndex, str.find("local.set $1"));
+  EXPECT_LT(storeIndex, str.find("call $use"));
+}
+
+TEST(LazyRootSpillingTest, SplitStoreIntoArms) {
+  std::unique_ptr<wasm::Module> m = lowerWithLazyRootSpilling(R"(
+    (func $f (param i32)
+      (local i32)
+      (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (if (local.get 0)
+        (then (call $use (call $~lib/rt/itcms/__new) (local.get 1)))
+        (else (local.set 0 (i32.const 1)))
+      )
+      (call $use (call $~lib/rt/itcms/__new) (local.get 1))
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  std::vector<wasm::If *> const ifs = wasm::FindAll<wasm::If>(f->body).list;
+  ASSERT_EQ(ifs.size(), 1U);
+  EXPECT_EQ(countToStackStores(ifs.front()->ifTrue), 1U);
+  EXPECT_EQ(countToStackStores(ifs.front()->ifFalse), 1U);
+  EXPECT_EQ(countToStackStores(f->body), 2U);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+
+#include "CollectLeafFunction.hpp"
+#include "StackAssigner.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief sink `local.set $x (__tostack<{offset}> ...)` stores of lowered function to the first possible collection on
+/// each path.
+/// @details paths which leave the shadow stack frame before any possible collection do not store at all. New stores are
+/// added to StackPositions, so later passes see them as tostack calls.
+struct LazyRootSpilling : public wasm::Pass {
+  std::shared_ptr<StackPositions> stackPositions_;
+  /// @brief GC leaf functions, nullptr means every call may collect
+  std::shared_ptr<LeafFunc const> leaf_;
+  LazyRootSpilling(std::shared_ptr<StackPositions> const &stackPositions, std::shared_ptr<LeafFunc const> const &leaf)
+      : stackPositions_(stackPositions), leaf_(leaf) {
+    name = "LazyRootSpilling";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override { return std::make_unique<LazyRootSpilling>(stackPositions_, leaf_); }
+  bool modifiesBinaryenIR() override { return true; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override;
+};
+
+} // namespace warpo::passes::gc
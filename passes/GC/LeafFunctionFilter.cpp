@@ -1,11 +1,18 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <map>
+#include <set>
+#include <utility>
 
+#include "../helper/BuildCallGraph.hpp"
 #include "CollectLeafFunction.hpp"
 #include "LeafFunctionFilter.hpp"
 #include "support/Debug.hpp"
 #include "support/DynBitSet.hpp"
+#include "support/name.h"
 #include "wasm-traversal.h"
+#include "wasm-type.h"
 #include "wasm.h"
 
 #define PASS_NAME "LeafFunctionFilter"
@@ -17,8 +24,10 @@ void LeafFunctionFilter::runOnFunction(wasm::Module *m, wasm::Function *func) {
     DynBitset validSSAValue_;
     LivenessMap const &livenessMap_;
     LeafFunc const &leaf_;
-    explicit Collector(LivenessMap const &livenessMap, LeafFunc const &leaf)
-        : validSSAValue_(livenessMap.getDimension()), livenessMap_(livenessMap), leaf_(leaf) {}
+    IndirectCallTargets const &indirectCallTargets_;
+    Collector(LivenessMap const &livenessMap, LeafFunc const &leaf, IndirectCallTargets const &indirectCallTargets)
+        : validSSAValue_(livenessMap.getDimension()), livenessMap_(livenessMap), leaf_(leaf),
+          indirectCallTargets_(indirectCallTargets) {}
 
     void visitCall(wasm::Call *expr) {
       // we don't handle leaf function call
@@ -27,11 +36,23 @@ void LeafFunctionFilter::runOnFunction(wasm::Module *m, wasm::Function *func) {
       markCurrentLivedSSAValid(expr);
     }
     void visitCallIndirect(wasm::CallIndirect *expr) {
-      // TODO: check if the target is a leaf function
-      markCurrentLivedSSAValid(expr);
+      // signature-compatible targets only depend on table and type
+      auto const key = std::make_pair(expr->table, expr->heapType.getID());
+      auto it = indirectCallMayCollect_.find(key);
+      if (it == indirectCallMayCollect_.end()) {
+        // UnknownCallee is never a leaf function
+        std::set<wasm::Name> const targets = indirectCallTargets_.get(*getModule(), expr);
+        bool const mayCollect = std::any_of(targets.begin(), targets.end(),
+                                            [this](wasm::Name const &target) { return !leaf_.contains(target); });
+        it = indirectCallMayCollect_.emplace(key, mayCollect).first;
+      }
+      if (it->second)
+        markCurrentLivedSSAValid(expr);
     }
 
   private:
+    std::map<std::pair<wasm::Name, wasm::TypeID>, bool> indirectCallMayCollect_{};
+
     void markCurrentLivedSSAValid(wasm::Expression *expr) {
       std::optional<Liveness> const l = livenessMap_.getLiveness(expr);
       assert(l.has_value());
@@ -41,7 +62,7 @@ void LeafFunctionFilter::runOnFunction(wasm::Module *m, wasm::Function *func) {
   };
 
   LivenessMap &livenessMap = info_->at(func);
-  Collector collector{livenessMap, *leaf_};
+  Collector collector{livenessMap, *leaf_, *indirectCallTargets_};
   collector.walkFunctionInModule(func, m);
   // TODO: mark parameters SSA valid
   if (support::isDebug(PASS_NAME, func->name.str)) {
@@ -59,3 +80,117 @@ void LeafFunctionFilter::runOnFunction(wasm::Module *m, wasm::Function *func) {
 }
 
 } // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../Runner.hpp"
+#include "../helper/ToString.hpp"
+#include "Lowering.hpp"
+#include "pass.h"
+
+namespace warpo::passes::ut {
+
+TEST(LeafFunctionFilterTest, CallIndirectToLeafTargets) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (type $v_v (func))
+      (type $i_v (func (param i32)))
+      (memory 1)
+      (global $~lib/memory/__stack_pointer (mut i32) (i32.const 0))
+      (global $~lib/memory/__data_end i32 (i32.const 0))
+      (table $0 3 3 funcref)
+      (elem $0 (i32.const 1) $leaf $alloc)
+      (func $~lib/rt/__localtostack (param i32) (result i32)
+        local.get 0
+      )
+      (func $~lib/rt/itcms/__new (result i32)
+        i32.const 0
+      )
+      (func $leaf)
+      (func $alloc (param i32)
+        (drop (call $~lib/rt/itcms/__new))
+      )
+      (func $call_leaf (param i32) (result i32)
+        (local i32)
+        (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+        (call_indirect (type $v_v) (local.get 0))
+        (local.get 1)
+      )
+      (func $call_alloc (param i32) (result i32)
+        (local i32)
+        (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+        (call_indirect (type $i_v) (i32.const 0) (local.get 0))
+        (local.get 1)
+      )
+    )
+  )");
+  wasm::PassRunner runner{m.get()};
+  runner.add(std::make_unique<GCLowering>(GCLowering::getDefaultConfig()));
+  runner.run();
+
+  EXPECT_EQ(toString(m->getFunction("call_leaf")).find("__tostack<"), std::string::npos);
+  EXPECT_NE(toString(m->getFunction("call_alloc")).find("__tostack<"), std::string::npos);
+}
+
+namespace {
+
+/// @brief whether `call_leaf` keeps its object on shadow stack across call_indirect to a table of leaf functions.
+bool isKeptAcrossLeafCallIndirect(std::string_view tableExtra, std::string_view callIndirect) {
+  std::unique_ptr<wasm::Module> m = loadWat(fmt::format(R"(
+    (module
+      (type $v_v (func))
+      (type $i_v (func (param i32)))
+      (memory 1)
+      (global $~lib/memory/__stack_pointer (mut i32) (i32.const 0))
+      (global $~lib/memory/__data_end i32 (i32.const 0))
+      (table $0 2 funcref)
+      (elem $0 (i32.const 1) $leaf)
+      {}
+      (func $~lib/rt/__localtostack (param i32) (result i32)
+        local.get 0
+      )
+      (func $~lib/rt/itcms/__new (result i32)
+        i32.const 0
+      )
+      (func $leaf)
+      (func $call_leaf (param i32) (result i32)
+        (local i32)
+        (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+        {}
+        (local.get 1)
+      )
+    )
+  )",
+                                                        tableExtra, callIndirect));
+  wasm::PassRunner runner{m.get()};
+  runner.add(std::make_unique<GCLowering>(GCLowering::getDefaultConfig()));
+  runner.run();
+  return toString(m->getFunction("call_leaf")).find("__tostack<") != std::string::npos;
+}
+
+} // namespace
+
+constexpr std::string_view callLeafType = "(call_indirect (type $v_v) (local.get 0))";
+
+TEST(LeafFunctionFilterTest, CallIndirectToClosedTable) {
+  EXPECT_FALSE(isKeptAcrossLeafCallIndirect("", callLeafType));
+}
+
+TEST(LeafFunctionFilterTest, CallIndirectToExportedTable) {
+  // host can put any function into exported table
+  EXPECT_TRUE(isKeptAcrossLeafCallIndirect(R"((export "table" (table $0)))", callLeafType));
+}
+
+TEST(LeafFunctionFilterTest, CallIndirectWithoutTargets) {
+  EXPECT_TRUE(isKeptAcrossLeafCallIndirect("", "(call_indirect (type $i_v) (i32.const 0) (local.get 0))"));
+}
+
+} // namespace warpo::passes::ut
+
+#endif
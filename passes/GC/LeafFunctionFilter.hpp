@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../helper/BuildCallGraph.hpp"
 #include "CollectLeafFunction.hpp"
 #include "ObjLivenessAnalyzer.hpp"
 #include "pass.h"
@@ -10,20 +11,26 @@ namespace warpo::passes::gc {
 /// @brief remove item in liveness which does not involve GC non leaf function
 struct LeafFunctionFilter : public wasm::Pass {
   std::shared_ptr<LeafFunc const> leaf_;
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets_;
   std::shared_ptr<ObjLivenessInfo> info_;
 
-  explicit LeafFunctionFilter(std::shared_ptr<LeafFunc const> const &leaf, std::shared_ptr<ObjLivenessInfo> const &info)
-      : leaf_(leaf), info_(info) {
+  LeafFunctionFilter(std::shared_ptr<LeafFunc const> const &leaf,
+                     std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
+                     std::shared_ptr<ObjLivenessInfo> const &info)
+      : leaf_(leaf), indirectCallTargets_(indirectCallTargets), info_(info) {
     name = "LeafFunctionFilter";
   }
   bool modifiesBinaryenIR() override { return false; }
   bool isFunctionParallel() override { return true; }
-  std::unique_ptr<Pass> create() override { return std::make_unique<LeafFunctionFilter>(leaf_, info_); }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<LeafFunctionFilter>(leaf_, indirectCallTargets_, info_);
+  }
   void runOnFunction(wasm::Module *m, wasm::Function *func) override;
 
   static void addToPass(wasm::PassRunner &runner, std::shared_ptr<LeafFunc> const &leaf,
+                        std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
                         std::shared_ptr<ObjLivenessInfo> const &info) {
-    runner.add(std::unique_ptr<wasm::Pass>(new LeafFunctionFilter(leaf, info)));
+    runner.add(std::unique_ptr<wasm::Pass>(new LeafFunctionFilter(leaf, indirectCallTargets, info)));
   }
 };
 
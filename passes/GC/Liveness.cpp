@@ -1,12 +1,15 @@
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <fmt/base.h>
 #include <fmt/ranges.h>
 #include <iostream>
+#include <iterator>
 #include <optional>
+#include <ostream>
 #include <queue>
-#include <set>
 #include <sstream>
 #include <utility>
 #include <vector>
@@ -67,48 +70,174 @@ Liveness LivenessMap::getLiveness(size_t const exprIndex) const {
 }
 
 void LivenessMap::mergeByColumns(size_t targetColumn, size_t sourceColumn, MergeOperator op) {
-  for (size_t const index : Range{2 * map_.size()}) {
-    size_t const targetIndex = index * dimension_ + targetColumn;
-    size_t const sourceIndex = index * dimension_ + sourceColumn;
-    switch (op) {
-    case MergeOperator::OR:
-      storage_.set(targetIndex, storage_.get(targetIndex) || storage_.get(sourceIndex));
-      break;
-    default:
-      assert(false);
+  switch (op) {
+  case MergeOperator::OR:
+    ranges_[targetColumn].merge(ranges_[sourceColumn]);
+    break;
+  default:
+    assert(false);
+  }
+}
+
+void LivenessMap::intersect(LivenessMap const &other) {
+  assert(dimension_ == other.dimension_ && map_.size() == other.map_.size());
+  for (size_t const index : Range{dimension_})
+    ranges_[index].intersect(other.ranges_[index]);
+}
+
+std::ostream &operator<<(std::ostream &os, LivenessMap const &livenessMap) {
+  for (size_t const index : Range{livenessMap.dimension_}) {
+    os << index << ":";
+    for (LiveInterval const &interval : livenessMap.ranges_[index].intervals())
+      os << " [" << interval.begin << ", " << interval.end << ")";
+    os << "\n";
+  }
+  return os;
+}
+
+void LiveRanges::set(size_t point, bool isLive) {
+  // first interval which ends after point
+  auto it = std::upper_bound(intervals_.begin(), intervals_.end(), point,
+                             [](size_t p, LiveInterval const &interval) { return p < interval.end; });
+  bool const isContained = it != intervals_.end() && it->begin <= point;
+  if (!isLive) {
+    if (!isContained)
+      return;
+    if (it->begin == point) {
+      it->begin++;
+    } else if (it->end == point + 1) {
+      it->end--;
+    } else {
+      LiveInterval const tail{.begin = point + 1, .end = it->end};
+      it->end = point;
+      intervals_.insert(it + 1, tail);
+      return;
     }
+    if (it->begin == it->end)
+      intervals_.erase(it);
+    return;
+  }
+  if (isContained)
+    return;
+  bool const extendsPrev = it != intervals_.begin() && std::prev(it)->end == point;
+  bool const extendsNext = it != intervals_.end() && it->begin == point + 1;
+  if (extendsPrev && extendsNext) {
+    std::prev(it)->end = it->end;
+    intervals_.erase(it);
+  } else if (extendsPrev) {
+    std::prev(it)->end = point + 1;
+  } else if (extendsNext) {
+    it->begin = point;
+  } else {
+    intervals_.insert(it, LiveInterval{.begin = point, .end = point + 1});
   }
 }
 
+bool LiveRanges::contains(size_t point) const {
+  auto const it = std::upper_bound(intervals_.begin(), intervals_.end(), point,
+                                   [](size_t p, LiveInterval const &interval) { return p < interval.end; });
+  return it != intervals_.end() && it->begin <= point;
+}
+
+void LiveRanges::merge(LiveRanges const &other) {
+  if (other.empty())
+    return;
+  std::vector<LiveInterval> merged{};
+  merged.reserve(intervals_.size() + other.intervals_.size());
+  auto a = intervals_.begin();
+  auto b = other.intervals_.begin();
+  while (a != intervals_.end() || b != other.intervals_.end()) {
+    LiveInterval const next =
+        (b == other.intervals_.end() || (a != intervals_.end() && a->begin < b->begin)) ? *(a++) : *(b++);
+    if (!merged.empty() && merged.back().end >= next.begin)
+      merged.back().end = std::max(merged.back().end, next.end);
+    else
+      merged.push_back(next);
+  }
+  intervals_ = std::move(merged);
+}
+
+void LiveRanges::intersect(LiveRanges const &other) {
+  std::vector<LiveInterval> intersected{};
+  auto a = intervals_.begin();
+  auto b = other.intervals_.begin();
+  while (a != intervals_.end() && b != other.intervals_.end()) {
+    size_t const begin = std::max(a->begin, b->begin);
+    size_t const end = std::min(a->end, b->end);
+    if (begin < end)
+      intersected.push_back(LiveInterval{.begin = begin, .end = end});
+    if (a->end < b->end)
+      a++;
+    else
+      b++;
+  }
+  intervals_ = std::move(intersected);
+}
+
+void ConflictGraph::addEdge(size_t a, size_t b) {
+  if (a == b)
+    return;
+  auto const insert = [](std::vector<size_t> &nodes, size_t node) {
+    auto const it = std::lower_bound(nodes.begin(), nodes.end(), node);
+    if (it == nodes.end() || *it != node)
+      nodes.insert(it, node);
+  };
+  insert(adjacency_[a], b);
+  insert(adjacency_[b], a);
+}
+
+bool ConflictGraph::isAdjacent(size_t a, size_t b) const {
+  return std::binary_search(adjacency_[a].begin(), adjacency_[a].end(), b);
+}
+
 ConflictGraph ConflictGraph::create(LivenessMap const &livenessMap) {
   size_t const dim = livenessMap.getDimension();
+  size_t const pointCount = 2 * livenessMap.getExprMap().size();
+  // bucket live intervals by begin and end point, then sweep program points once.
+  // a value starting at a point conflicts with every value which is still active.
+  std::vector<std::vector<size_t>> begins(pointCount + 1);
+  std::vector<std::vector<size_t>> ends(pointCount + 1);
+  for (size_t const ssaIndex : Range{dim}) {
+    if (livenessMap.isInvalid(ssaIndex))
+      continue;
+    for (LiveInterval const &interval : livenessMap.getLiveRanges(ssaIndex).intervals()) {
+      begins[interval.begin].push_back(ssaIndex);
+      ends[interval.end].push_back(ssaIndex);
+    }
+  }
+
   ConflictGraph graph{dim};
-  for (auto &[expr, line] : livenessMap.getExprMap()) {
-    static_cast<void>(expr);
-    Liveness const liveness = livenessMap.getLiveness(line);
-    std::set<size_t> visitedLivenessSSAsForBefore{};
-    std::set<size_t> visitedLivenessSSAsForAfter{};
-    for (size_t const ssaIndex : Range{dim}) {
-      if (liveness.before().get(ssaIndex) == true) {
-        for (size_t const oldSSAIndex : visitedLivenessSSAsForBefore)
-          graph.addEdge(oldSSAIndex, ssaIndex);
-        visitedLivenessSSAsForBefore.insert(ssaIndex);
-      }
-      if (liveness.after().get(ssaIndex) == true) {
-        for (size_t const oldSSAIndex : visitedLivenessSSAsForAfter)
-          graph.addEdge(oldSSAIndex, ssaIndex);
-        visitedLivenessSSAsForAfter.insert(ssaIndex);
+  std::vector<size_t> active{};
+  std::vector<size_t> activePosition(dim);
+  for (size_t const point : Range{pointCount + 1}) {
+    for (size_t const ssaIndex : ends[point]) {
+      size_t const position = activePosition[ssaIndex];
+      active[position] = active.back();
+      activePosition[active[position]] = position;
+      active.pop_back();
+    }
+    for (size_t const ssaIndex : begins[point]) {
+      for (size_t const other : active) {
+        graph.adjacency_[ssaIndex].push_back(other);
+        graph.adjacency_[other].push_back(ssaIndex);
       }
+      activePosition[ssaIndex] = active.size();
+      active.push_back(ssaIndex);
     }
   }
+  // the same pair can overlap in several intervals
+  for (std::vector<size_t> &nodes : graph.adjacency_) {
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  }
   return graph;
 }
 
 void ConflictGraph::dump() const {
-  for (size_t const line : Range{dim_}) {
+  for (size_t const line : Range{adjacency_.size()}) {
     fmt::print("{}: ", line);
-    for (size_t const column : Range{dim_})
-      fmt::print("{} ", isAdjacent(line, column) ? '+' : ' ');
+    for (size_t const column : adjacency_[line])
+      fmt::print("{} ", column);
     fmt::println("");
   }
 }
@@ -120,6 +249,15 @@ void ColorVec::dump() const {
   fmt::println("");
 }
 
+size_t ColorVec::getColorCount() const {
+  size_t count = 0;
+  for (size_t const color : (*this)) {
+    if (color != InvalidColor)
+      count = std::max(count, color + 1);
+  }
+  return count;
+}
+
 // welch powell algorithm
 ColorVec ConflictGraph::color() const {
   // pre-sort the nodes by degree
@@ -135,24 +273,18 @@ ColorVec ConflictGraph::color() const {
     using P::empty;
   };
   SortedNodes sortedNodes{};
-  for (size_t const line : Range{dim_}) {
-    size_t cnt = 0;
-    for (size_t const column : Range{dim_}) {
-      if (isAdjacent(line, column))
-        cnt++;
-    }
-    sortedNodes.insert(cnt, line);
-  }
+  for (size_t const line : Range{adjacency_.size()})
+    sortedNodes.insert(adjacency_[line].size(), line);
 
   // visit from the largest degree
-  ColorVec nodeColor{dim_};
+  ColorVec nodeColor{adjacency_.size()};
   size_t currentNewColor = 0;
 
   while (!sortedNodes.empty()) {
     size_t const line = sortedNodes.pop();
     DynBitset usedColors{currentNewColor}; // color index -> is used
-    for (size_t const column : Range{dim_}) {
-      if (isAdjacent(line, column) && nodeColor.hasColor(column)) {
+    for (size_t const column : adjacency_[line]) {
+      if (nodeColor.hasColor(column)) {
         // remove the color of the adjacent node
         usedColors.set(nodeColor.getColor(column), true);
       }
@@ -171,16 +303,271 @@ ColorVec ConflictGraph::color() const {
   return nodeColor;
 }
 
+namespace {
+
+using Adjacency = std::vector<std::vector<size_t>>;
+
+/// @brief maximum cardinality search, the reverse of the order is a perfect elimination order for chordal graphs.
+std::vector<size_t> getMaximumCardinalitySearchOrder(Adjacency const &adjacency) {
+  size_t const n = adjacency.size();
+  std::vector<size_t> weight(n, 0);
+  DynBitset visited{n};
+  // buckets contain stale entries, they are skipped when popped.
+  std::vector<std::vector<size_t>> buckets(1);
+  for (size_t const node : Range<-1>{n, 0})
+    buckets[0].push_back(node - 1);
+  size_t maxWeight = 0;
+  std::vector<size_t> order{};
+  order.reserve(n);
+  while (order.size() < n) {
+    while (buckets[maxWeight].empty())
+      maxWeight--;
+    size_t const node = buckets[maxWeight].back();
+    buckets[maxWeight].pop_back();
+    if (visited.get(node) || weight[node] != maxWeight)
+      continue;
+    visited.set(node, true);
+    order.push_back(node);
+    for (size_t const neighbor : adjacency[node]) {
+      if (visited.get(neighbor))
+        continue;
+      weight[neighbor]++;
+      if (buckets.size() <= weight[neighbor])
+        buckets.emplace_back();
+      buckets[weight[neighbor]].push_back(neighbor);
+      maxWeight = std::max(maxWeight, weight[neighbor]);
+    }
+  }
+  return order;
+}
+
+bool isChordal(Adjacency const &adjacency, std::vector<size_t> const &order) {
+  std::vector<size_t> position(adjacency.size());
+  for (size_t const i : Range{order.size()})
+    position[order[i]] = i;
+  // earlier neighbors of each node must be adjacent to the latest one of them.
+  for (size_t const node : order) {
+    std::optional<size_t> parent{};
+    for (size_t const neighbor : adjacency[node]) {
+      if (position[neighbor] < position[node] && (!parent.has_value() || position[neighbor] > position[*parent]))
+        parent = neighbor;
+    }
+    if (!parent.has_value())
+      continue;
+    for (size_t const neighbor : adjacency[node]) {
+      if (position[neighbor] < position[*parent] &&
+          !std::binary_search(adjacency[*parent].begin(), adjacency[*parent].end(), neighbor))
+        return false;
+    }
+  }
+  return true;
+}
+
+/// @brief color each node in order with the smallest color which is not used by its neighbors.
+ColorVec colorInOrder(Adjacency const &adjacency, std::vector<size_t> const &order) {
+  ColorVec nodeColor{adjacency.size()};
+  std::vector<size_t> usedBy{}; // color -> last node which sees the color on its neighbor
+  for (size_t const node : order) {
+    for (size_t const neighbor : adjacency[node]) {
+      if (!nodeColor.hasColor(neighbor))
+        continue;
+      size_t const color = nodeColor.getColor(neighbor);
+      if (usedBy.size() <= color)
+        usedBy.resize(color + 1, SIZE_MAX);
+      usedBy[color] = node;
+    }
+    size_t color = 0;
+    while (color < usedBy.size() && usedBy[color] == node)
+      color++;
+    nodeColor.setColor(node, color);
+  }
+  return nodeColor;
+}
+
+/// @brief backtracking search of a coloring with fewer colors for one connected component.
+class ExactColoring {
+  static constexpr size_t StepLimit = 1U << 16U;
+  Adjacency const &adjacency_;
+  std::vector<size_t> const &nodes_;
+  ColorVec &nodeColor_;
+  size_t steps_ = 0;
+
+  bool assign(size_t index, size_t colorLimit, size_t usedColors) {
+    if (index == nodes_.size())
+      return true;
+    if (++steps_ > StepLimit)
+      return false;
+    size_t const node = nodes_[index];
+    // a new color is symmetric to any other unused color, only try the first one.
+    for (size_t const color : Range{std::min(colorLimit, usedColors + 1)}) {
+      bool const conflicted = std::any_of(adjacency_[node].begin(), adjacency_[node].end(), [&](size_t neighbor) {
+        return nodeColor_.hasColor(neighbor) && nodeColor_.getColor(neighbor) == color;
+      });
+      if (conflicted)
+        continue;
+      nodeColor_.setColor(node, color);
+      if (assign(index + 1, colorLimit, std::max(usedColors, color + 1)))
+        return true;
+    }
+    nodeColor_.clearColor(node);
+    return false;
+  }
+
+public:
+  static constexpr size_t NodeLimit = 64U;
+  ExactColoring(Adjacency const &adjacency, std::vector<size_t> const &nodes, ColorVec &nodeColor)
+      : adjacency_(adjacency), nodes_(nodes), nodeColor_(nodeColor) {}
+
+  /// @brief try colorings with fewer colors than currentColorCount until it fails or runs out of steps.
+  void improve(size_t currentColorCount) {
+    std::vector<size_t> best{};
+    for (size_t const node : nodes_)
+      best.push_back(nodeColor_.getColor(node));
+    for (size_t colorLimit = currentColorCount - 1; colorLimit > 0; colorLimit--) {
+      for (size_t const node : nodes_)
+        nodeColor_.clearColor(node);
+      if (!assign(0, colorLimit, 0))
+        break;
+      for (size_t const i : Range{nodes_.size()})
+        best[i] = nodeColor_.getColor(nodes_[i]);
+    }
+    for (size_t const i : Range{nodes_.size()})
+      nodeColor_.setColor(nodes_[i], best[i]);
+  }
+};
+
+} // namespace
+
+ColorVec ConflictGraph::colorOptimal() const {
+  std::vector<size_t> const order = getMaximumCardinalitySearchOrder(adjacency_);
+  ColorVec nodeColor = colorInOrder(adjacency_, order);
+  if (isChordal(adjacency_, order))
+    return nodeColor;
+
+  ColorVec greedyColor = color();
+  if (greedyColor.getColorCount() < nodeColor.getColorCount())
+    nodeColor = std::move(greedyColor);
+
+  // components are colored independently, keep maximum cardinality search order inside each of them.
+  std::vector<size_t> component(adjacency_.size(), SIZE_MAX);
+  std::vector<std::vector<size_t>> components{};
+  for (size_t const root : order) {
+    if (component[root] != SIZE_MAX)
+      continue;
+    std::vector<size_t> stack{root};
+    component[root] = components.size();
+    while (!stack.empty()) {
+      size_t const node = stack.back();
+      stack.pop_back();
+      for (size_t const neighbor : adjacency_[node]) {
+        if (component[neighbor] == SIZE_MAX) {
+          component[neighbor] = components.size();
+          stack.push_back(neighbor);
+        }
+      }
+    }
+    components.emplace_back();
+  }
+  for (size_t const node : order)
+    components[component[node]].push_back(node);
+
+  for (std::vector<size_t> const &nodes : components) {
+    if (nodes.size() > ExactColoring::NodeLimit)
+      continue;
+    size_t colorCount = 0;
+    for (size_t const node : nodes)
+      colorCount = std::max(colorCount, nodeColor.getColor(node) + 1);
+    if (colorCount <= 2)
+      continue;
+    ExactColoring{adjacency_, nodes, nodeColor}.improve(colorCount);
+  }
+  return nodeColor;
+}
+
 } // namespace warpo::passes::gc
 
 #ifdef WARPO_ENABLE_UNIT_TESTS
 
+#include <array>
 #include <gtest/gtest.h>
 
 namespace warpo::passes::ut {
 
 using namespace gc;
 
+TEST(LiveRangesTest, SetAndClear) {
+  LiveRanges ranges{};
+  ranges.set(3, true);
+  ranges.set(1, true);
+  ranges.set(2, true);
+  ranges.set(6, true);
+  EXPECT_EQ(ranges.intervals(), (std::vector<LiveInterval>{{1, 4}, {6, 7}}));
+  ranges.set(5, true);
+  EXPECT_EQ(ranges.intervals(), (std::vector<LiveInterval>{{1, 4}, {5, 7}}));
+  ranges.set(4, true);
+  EXPECT_EQ(ranges.intervals(), (std::vector<LiveInterval>{{1, 7}}));
+  ranges.set(3, false);
+  EXPECT_EQ(ranges.intervals(), (std::vector<LiveInterval>{{1, 3}, {4, 7}}));
+  ranges.set(1, false);
+  ranges.set(6, false);
+  ranges.set(0, false);
+  EXPECT_EQ(ranges.intervals(), (std::vector<LiveInterval>{{2, 3}, {4, 6}}));
+  EXPECT_TRUE(ranges.contains(2));
+  EXPECT_FALSE(ranges.contains(3));
+  EXPECT_TRUE(ranges.contains(5));
+  EXPECT_FALSE(ranges.contains(6));
+}
+
+TEST(LiveRangesTest, MergeAndIntersect) {
+  LiveRanges a{};
+  LiveRanges b{};
+  for (size_t const point : {0, 1, 2, 6, 7})
+    a.set(point, true);
+  for (size_t const point : {2, 3, 4, 7, 8, 10})
+    b.set(point, true);
+
+  LiveRanges merged = a;
+  merged.merge(b);
+  EXPECT_EQ(merged.intervals(), (std::vector<LiveInterval>{{0, 5}, {6, 9}, {10, 11}}));
+
+  LiveRanges intersected = a;
+  intersected.intersect(b);
+  EXPECT_EQ(intersected.intervals(), (std::vector<LiveInterval>{{2, 3}, {7, 8}}));
+}
+
+TEST(ConflictGraphTest, CreateFromLiveRanges) {
+  SSAMap ssaMap{};
+  for (size_t const index : Range{3})
+    ssaMap.insert(SSAValue{static_cast<wasm::Index>(index)});
+  std::array<wasm::Nop, 3> exprs{};
+  LivenessMap livenessMap{ssaMap};
+  for (wasm::Nop &expr : exprs)
+    livenessMap.ensureExpression(&expr);
+  using Pos = LivenessMap::Pos;
+  auto const setLive = [&livenessMap](size_t exprIndex, Pos pos, size_t ssaIndex) {
+    livenessMap.set(exprIndex, pos, ssaIndex, true);
+  };
+  // 0: [0, 4), 1: [0, 1) [3, 5), 2: [5, 6)
+  setLive(0, Pos::Before, 0);
+  setLive(0, Pos::After, 0);
+  setLive(1, Pos::Before, 0);
+  setLive(1, Pos::After, 0);
+  setLive(0, Pos::Before, 1);
+  setLive(1, Pos::After, 1);
+  setLive(2, Pos::Before, 1);
+  setLive(2, Pos::After, 2);
+
+  ConflictGraph const graph = ConflictGraph::create(livenessMap);
+  EXPECT_EQ(graph.getAdjacentNodes(0), (std::vector<size_t>{1}));
+  EXPECT_EQ(graph.getAdjacentNodes(1), (std::vector<size_t>{0}));
+  EXPECT_TRUE(graph.getAdjacentNodes(2).empty());
+
+  DynBitset invalid{3};
+  invalid.set(1, true);
+  livenessMap.setInvalid(invalid);
+  EXPECT_TRUE(ConflictGraph::create(livenessMap).getAdjacentNodes(0).empty());
+}
+
 TEST(ConflictGraphTest, Color1) {
   ConflictGraph graph{4};
   //     0 1 2 3
@@ -202,6 +589,32 @@ TEST(ConflictGraphTest, Color1) {
   EXPECT_EQ(color.getColor(3), 0);
 }
 
+TEST(ConflictGraphTest, ColorOptimalOnChordalGraph) {
+  // path 3 - 4 - 1 - 0 - 5 - 2
+  ConflictGraph graph{6};
+  std::vector<std::pair<size_t, size_t>> const edges{{0, 1}, {0, 5}, {1, 4}, {2, 5}, {3, 4}};
+  for (auto const &[a, b] : edges)
+    graph.addEdge(a, b);
+  EXPECT_EQ(graph.color().getColorCount(), 3);
+
+  ColorVec const color = graph.colorOptimal();
+  EXPECT_EQ(color.getColorCount(), 2);
+  for (auto const &[a, b] : edges)
+    EXPECT_NE(color.getColor(a), color.getColor(b));
+}
+
+TEST(ConflictGraphTest, ColorOptimalOnCycle) {
+  // cycle with 6 nodes is not chordal
+  ConflictGraph graph{6};
+  for (size_t const node : Range{6})
+    graph.addEdge(node, (node + 1) % 6);
+
+  ColorVec const color = graph.colorOptimal();
+  EXPECT_EQ(color.getColorCount(), 2);
+  for (size_t const node : Range{6})
+    EXPECT_NE(color.getColor(node), color.getColor((node + 1) % 6));
+}
+
 TEST(ConflictGraphTest, Color2) {
   ConflictGraph graph{2};
   // 0: + +
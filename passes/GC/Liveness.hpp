@@ -2,6 +2,8 @@
 
 #include <cstddef>
 #include <optional>
+#include <ostream>
+#include <vector>
 
 #include "SSAObj.hpp"
 #include "support/DynBitSet.hpp"
@@ -27,25 +29,48 @@ public:
   }
 };
 
+/// @brief half-open range [begin, end) of program points.
+struct LiveInterval {
+  size_t begin;
+  size_t end;
+  bool operator==(LiveInterval const &other) const = default;
+};
+
+/// @brief live ranges of one SSA value, stored as sorted and disjoint intervals.
+class LiveRanges {
+  std::vector<LiveInterval> intervals_;
+
+public:
+  void set(size_t point, bool isLive);
+  bool contains(size_t point) const;
+  bool empty() const { return intervals_.empty(); }
+  std::vector<LiveInterval> const &intervals() const { return intervals_; }
+
+  /// @brief union with other
+  void merge(LiveRanges const &other);
+  /// @brief intersection with other
+  void intersect(LiveRanges const &other);
+};
+
+/// @brief SSA value liveness of all tracked exprs.
+/// @details each tracked expr has two program points (before and after) in the linear numbering `2 * base + pos`.
+/// liveness is stored as live ranges per SSA value, so memory is proportional to the number of ranges instead of
+/// tracked exprs * SSA values.
 struct LivenessMap {
-  LivenessMap() : storage_(0U), map_{}, dimension_(0), invalid_(0) {}
+  LivenessMap() : ranges_{}, map_{}, dimension_(0), invalid_(0) {}
   explicit LivenessMap(SSAMap const &ssaMap)
-      : storage_(0U), map_{}, dimension_(ssaMap.size()), invalid_(ssaMap.size()) {}
+      : ranges_(ssaMap.size()), map_{}, dimension_(ssaMap.size()), invalid_(ssaMap.size()) {}
   enum class Pos { Before, After };
-  void set(size_t base, Pos pos, size_t index, bool isLive) {
-    storage_.set((2 * base + (pos == Pos::Before ? 0 : 1)) * dimension_ + index, isLive);
-  }
+  static size_t getPoint(size_t base, Pos pos) { return 2 * base + (pos == Pos::Before ? 0 : 1); }
+  void set(size_t base, Pos pos, size_t index, bool isLive) { ranges_[index].set(getPoint(base, pos), isLive); }
   void set(wasm::Expression *expr, Pos pos, size_t index, bool isLive) {
     set(getIndexBase(expr).value(), pos, index, isLive);
   }
-  bool get(ssize_t base, Pos pos, size_t index) const {
-    return storage_.get((2 * base + (pos == Pos::Before ? 0 : 1)) * dimension_ + index);
-  }
+  bool get(size_t base, Pos pos, size_t index) const { return ranges_[index].contains(getPoint(base, pos)); }
   void ensureExpression(wasm::Expression *expr) {
     if (map_.contains(expr))
       return;
     map_.insert(expr);
-    storage_.resize(storage_.size() + dimension_ * 2);
   }
   size_t getDimension() const { return dimension_; }
   std::optional<size_t> getIndexBase(wasm::Expression *expr) const {
@@ -55,19 +80,24 @@ struct LivenessMap {
   }
   std::optional<Liveness> getLiveness(wasm::Expression *expr) const;
   Liveness getLiveness(size_t exprIndex) const;
+  /// @brief live ranges of SSA value without applying invalid SSA values.
+  LiveRanges const &getLiveRanges(size_t index) const { return ranges_[index]; }
 
   void setInvalid(DynBitset invalid) { invalid_ |= invalid; }
+  bool isInvalid(size_t index) const { return invalid_.get(index); }
 
   void dump(wasm::Function *func) const;
+  friend std::ostream &operator<<(std::ostream &os, LivenessMap const &livenessMap);
 
   enum class MergeOperator { OR };
   void mergeByColumns(size_t targetColumn, size_t sourceColumn, MergeOperator op);
+  /// @brief keep the liveness which also exists in other, both maps must track the same exprs.
+  void intersect(LivenessMap const &other);
 
   IncMap<wasm::Expression *> const &getExprMap() const { return map_; }
 
-  DynBitset storage_;
-
 private:
+  std::vector<LiveRanges> ranges_;
   IncMap<wasm::Expression *> map_;
   size_t dimension_;
   DynBitset invalid_;
@@ -81,25 +111,31 @@ public:
   explicit ColorVec(size_t dim) { resize(dim, InvalidColor); }
   size_t getColor(size_t ssaIndex) const { return (*this)[ssaIndex]; }
   size_t setColor(size_t ssaIndex, size_t color) { return (*this)[ssaIndex] = color; }
+  void clearColor(size_t ssaIndex) { (*this)[ssaIndex] = InvalidColor; }
   bool hasColor(size_t ssaIndex) const { return getColor(ssaIndex) != InvalidColor; }
+  /// @brief number of used colors, which is the number of shadow stack slots.
+  size_t getColorCount() const;
   void dump() const;
 };
 
-/// @brief conflict graph for SSA values
+/// @brief conflict graph for SSA values, stored as sorted adjacency lists.
 class ConflictGraph {
-  DynBitset conflictAdjacencyMatrix_;
-  size_t dim_;
+  std::vector<std::vector<size_t>> adjacency_;
 
 public:
-  explicit ConflictGraph(size_t nodeCount) : conflictAdjacencyMatrix_(nodeCount * nodeCount), dim_(nodeCount) {}
-  void addEdge(size_t a, size_t b) {
-    conflictAdjacencyMatrix_.set(a * dim_ + b, true);
-    conflictAdjacencyMatrix_.set(b * dim_ + a, true);
-  }
-  bool isAdjacent(size_t a, size_t b) const { return conflictAdjacencyMatrix_.get(a * dim_ + b); }
+  explicit ConflictGraph(size_t nodeCount) : adjacency_(nodeCount) {}
+  void addEdge(size_t a, size_t b);
+  bool isAdjacent(size_t a, size_t b) const;
+  std::vector<size_t> const &getAdjacentNodes(size_t node) const { return adjacency_[node]; }
 
+  /// @brief greedy coloring by degree (welch powell).
   ColorVec color() const;
+  /// @brief coloring with minimal or near minimal color count.
+  /// @details SSA conflict graphs are mostly chordal, coloring along maximum cardinality search order is optimal for
+  /// them. Small components which are not chordal are solved exactly. It never uses more colors than `color()`.
+  ColorVec colorOptimal() const;
 
+  /// @brief two valid SSA values conflict when they are live at the same program point.
   static ConflictGraph create(LivenessMap const &livenessMap);
   void dump() const;
 };
@@ -3,18 +3,30 @@
 #include <cstddef>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "../helper/TimeReport.hpp"
 #include "CollectLeafFunction.hpp"
 #include "GCInfo.hpp"
+#include "LazyRootSpilling.hpp"
 #include "LeafFunctionFilter.hpp"
 #include "Lowering.hpp"
+#include "ManagedParams.hpp"
 #include "MergeSSA.hpp"
 #include "ObjLivenessAnalyzer.hpp"
 #include "SSAObj.hpp"
+#include "ShrinkWrap.hpp"
+#include "SlotAssignment.hpp"
 #include "StackAssigner.hpp"
+#include "StackDepth.hpp"
+#include "StackPositionCache.hpp"
+#include "ToStackStoreOptimizer.hpp"
 #include "argparse/argparse.hpp"
+#include "fmt/base.h"
 #include "fmt/format.h"
+#include "ir/find_all.h"
 #include "literal.h"
 #include "pass.h"
 #include "passes/passes.h"
@@ -32,6 +44,14 @@ static cli::Opt<bool> NoLeafFunctionFilter{
     "--no-gc-leaf-function-filter",
     [](argparse::Argument &arg) { arg.help("Disable leaf function filter during GC lowering").flag(); },
 };
+static cli::Opt<bool> ReturningCollectionSummary{
+    "--gc-returning-collection-summary",
+    [](argparse::Argument &arg) {
+      arg.help("Only keep objects live across calls which may collect on a path returning to the caller during GC "
+               "lowering")
+          .flag();
+    },
+};
 static cli::Opt<bool> NoMergeSSA{
     "--no-gc-merge-ssa",
     [](argparse::Argument &arg) { arg.help("Disable SSA merging during GC lowering").flag(); },
@@ -40,6 +60,73 @@ static cli::Opt<bool> NoOptimizedStackPositionAssigner{
     "--no-gc-optimized-stack-position-assigner",
     [](argparse::Argument &arg) { arg.help("Disable optimized stack position assigner during GC lowering").flag(); },
 };
+static cli::Opt<bool> OptimalStackPositionAssigner{
+    "--gc-optimal-stack-position-assigner",
+    [](argparse::Argument &arg) {
+      arg.help("Minimize shadow stack slots with perfect elimination order and exact coloring during GC lowering")
+          .flag();
+    },
+};
+static cli::Opt<bool> ShrinkWrap{
+    "--gc-shrink-wrap",
+    [](argparse::Argument &arg) {
+      arg.help("Set up shadow stack frame only around the region which stores to shadow stack during GC lowering")
+          .flag();
+    },
+};
+static cli::Opt<bool> ElideFrameFill{
+    "--gc-elide-frame-fill",
+    [](argparse::Argument &arg) {
+      arg.help("Skip zero filling shadow stack frame when every slot is stored before any possible collection during "
+               "GC lowering")
+          .flag();
+    },
+};
+static cli::Opt<bool> InterproceduralStackCheck{
+    "--gc-interprocedural-stack-check",
+    [](argparse::Argument &arg) {
+      arg.help("Check shadow stack overflow once per non-recursive call tree instead of per frame during GC lowering")
+          .flag();
+    },
+};
+static cli::Opt<bool> LazyRootSpilling{
+    "--gc-lazy-root-spilling",
+    [](argparse::Argument &arg) {
+      arg.help("Sink tostack stores of locals to the first possible collection on each path during GC lowering").flag();
+    },
+};
+static cli::Opt<bool> OptimizeToStackStores{
+    "--gc-optimize-tostack-stores",
+    [](argparse::Argument &arg) {
+      arg.help("Hoist loop invariant tostack stores and remove redundant tostack stores during GC lowering").flag();
+    },
+};
+static cli::Opt<bool> FusedLowering{
+    "--gc-fused-lowering",
+    [](argparse::Argument &arg) {
+      arg.help("Run analysis and lowering of each function in one parallel task during GC lowering").flag();
+    },
+};
+static cli::Opt<bool> StackSlotReport{
+    "--gc-stack-slot-report",
+    [](argparse::Argument &arg) {
+      arg.help("Report shadow stack slots of GC lowering against greedy coloring to stderr").flag();
+    },
+};
+
+static cli::Opt<bool> StackDepthReport{
+    "--gc-stack-depth-report",
+    [](argparse::Argument &arg) {
+      arg.help("Report worst case shadow stack depth of exported functions after GC lowering to stderr").flag();
+    },
+};
+
+static cli::Opt<std::string> GCCacheDir{
+    "--gc-cache-dir",
+    [](argparse::Argument &arg) {
+      arg.help("Directory to cache stack positions of functions across builds during GC lowering");
+    },
+};
 
 static cli::Opt<bool> TestOnlyControlGroup{
     "--gc-test-only-control-group",
@@ -57,12 +144,22 @@ static wasm::Name getToStackFunctionName(uint32_t offset) {
 // insert to end => increase SP
 struct ToStackCallLowering : public wasm::Pass {
   std::shared_ptr<StackPositions const> stackPositions_;
-  explicit ToStackCallLowering(std::shared_ptr<StackPositions const> const &stackPositions)
-      : stackPositions_(stackPositions) {
+  /// @brief liveness to shrink wrap the shadow stack frame, nullptr means wrapping the whole function body
+  std::shared_ptr<ObjLivenessInfo const> livenessInfo_;
+  /// @brief GC leaf functions, nullptr means every call may collect
+  std::shared_ptr<LeafFunc const> leaf_;
+  /// @brief set up frame without zero filling when every slot is stored before any possible collection
+  bool elideFrameFill_;
+  explicit ToStackCallLowering(std::shared_ptr<StackPositions const> const &stackPositions,
+                               std::shared_ptr<ObjLivenessInfo const> const &livenessInfo,
+                               std::shared_ptr<LeafFunc const> const &leaf, bool elideFrameFill)
+      : stackPositions_(stackPositions), livenessInfo_(livenessInfo), leaf_(leaf), elideFrameFill_(elideFrameFill) {
     name = "LowerToStackCall";
   }
   bool isFunctionParallel() override { return true; }
-  std::unique_ptr<Pass> create() override { return std::make_unique<ToStackCallLowering>(stackPositions_); }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<ToStackCallLowering>(stackPositions_, livenessInfo_, leaf_, elideFrameFill_);
+  }
   bool modifiesBinaryenIR() override { return true; }
   void runOnFunction(wasm::Module *m, wasm::Function *func) override;
 };
@@ -72,6 +169,7 @@ void ToStackCallLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
     wasm::Function *func;
     StackPosition const &stackPosition_;
     uint32_t maxShadowStackOffset_ = 0;
+    std::vector<wasm::Call *> toStackCalls_;
     explicit CallReplacer(StackPosition const &input, wasm::Function *func) : stackPosition_(input), func(func) {}
     void visitCall(wasm::Call *expr) {
       if (expr->target != FnLocalToStack && expr->target != FnTmpToStack)
@@ -87,6 +185,7 @@ void ToStackCallLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
         maxShadowStackOffset_ = std::max(offset + 4U, maxShadowStackOffset_);
         wasm::Builder builder{*getModule()};
         expr->target = getToStackFunctionName(offset);
+        toStackCalls_.push_back(expr);
       }
     }
   };
@@ -110,7 +209,7 @@ void ToStackCallLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
       replaceCurrent(b.makeBlock(
           {
               b.makeLocalSet(scratchReturnValueLocalIndex_, expr->value),
-              b.makeCall("~lib/rt/__increase_sp", {b.makeConst(wasm::Literal(maxShadowStackOffset_))},
+              b.makeCall(FnIncreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset_))},
                          wasm::Type::none),
               expr,
           },
@@ -126,7 +225,7 @@ void ToStackCallLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
       wasm::Builder b{*getModule()};
       replaceCurrent(b.makeBlock(
           {
-              b.makeCall("~lib/rt/__increase_sp", {b.makeConst(wasm::Literal(maxShadowStackOffset_))},
+              b.makeCall(FnIncreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset_))},
                          wasm::Type::none),
               expr,
           },
@@ -134,41 +233,91 @@ void ToStackCallLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
     }
   };
 
+  std::optional<ShrinkWrapRegion> region{};
+  if (livenessInfo_ != nullptr) {
+    LivenessMap const &livenessMap = livenessInfo_->at(func);
+    // functions loaded from stack position cache have no liveness
+    if (livenessMap.getDimension() != 0U)
+      region = findShrinkWrapRegion(func, callReplacer.toStackCalls_, livenessMap,
+                                    getRootedSSAValues(stackPosition, livenessMap));
+  }
+
   wasm::Type const resultType = func->getResults();
   wasm::Builder b{*m};
-  if (resultType == wasm::Type::none) {
+  uint32_t const maxShadowStackOffset = callReplacer.maxShadowStackOffset_;
+  wasm::Call *const decreaseSP =
+      b.makeCall(FnDecreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset))}, wasm::Type::none);
+  if (region.has_value()) {
+    // returns outside of region leave the function before the frame is set up
+    wasm::Block *const block = region->block;
+    std::vector<wasm::Expression *> items{decreaseSP};
+    items.insert(items.end(), block->list.begin() + region->begin, block->list.begin() + region->end);
+    wasm::Type const lastType = items.back()->type;
+    std::optional<wasm::Index> scratchLocalIndex{};
+    if (lastType.isConcrete()) {
+      scratchLocalIndex = wasm::Builder::addVar(func, lastType);
+      items.back() = b.makeLocalSet(scratchLocalIndex.value(), items.back());
+    }
+    items.push_back(b.makeCall(FnIncreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset))}, wasm::Type::none));
+    if (scratchLocalIndex.has_value())
+      items.push_back(b.makeLocalGet(scratchLocalIndex.value(), lastType));
+    wasm::Block *const wrapper = b.makeBlock(items);
+
+    std::vector<wasm::Expression *> list{block->list.begin(), block->list.begin() + region->begin};
+    list.push_back(wrapper);
+    list.insert(list.end(), block->list.begin() + region->end, block->list.end());
+    block->list.set(list);
+    block->finalize(block->type);
+
+    bool const hasReturn = !wasm::FindAll<wasm::Return>(wrapper).list.empty();
+    if (hasReturn && resultType == wasm::Type::none) {
+      ReturnWithoutResultReplacer returnReplacer{maxShadowStackOffset};
+      returnReplacer.setModule(m);
+      returnReplacer.setFunction(func);
+      returnReplacer.walk(block->list[region->begin]);
+    } else if (hasReturn) {
+      ReturnWithResultReplacer returnReplacer{wasm::Builder::addVar(func, resultType), maxShadowStackOffset,
+                                              resultType};
+      returnReplacer.setModule(m);
+      returnReplacer.setFunction(func);
+      returnReplacer.walk(block->list[region->begin]);
+    }
+  } else if (resultType == wasm::Type::none) {
     func->body = b.makeBlock(
         {
-            b.makeCall("~lib/rt/__decrease_sp", {b.makeConst(wasm::Literal(callReplacer.maxShadowStackOffset_))},
-                       wasm::Type::none),
+            decreaseSP,
             func->body,
-            b.makeCall("~lib/rt/__increase_sp", {b.makeConst(wasm::Literal(callReplacer.maxShadowStackOffset_))},
-                       wasm::Type::none),
+            b.makeCall(FnIncreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset))}, wasm::Type::none),
         },
         resultType);
-    ReturnWithoutResultReplacer returnReplacer{callReplacer.maxShadowStackOffset_};
+    ReturnWithoutResultReplacer returnReplacer{maxShadowStackOffset};
     returnReplacer.walkFunctionInModule(func, m);
   } else {
     wasm::Index const scratchReturnValueLocalIndex = wasm::Builder::addVar(func, resultType);
     func->body = b.makeBlock(
         {
-            b.makeCall("~lib/rt/__decrease_sp", {b.makeConst(wasm::Literal(callReplacer.maxShadowStackOffset_))},
-                       wasm::Type::none),
+            decreaseSP,
             b.makeLocalSet(scratchReturnValueLocalIndex, func->body),
-            b.makeCall("~lib/rt/__increase_sp", {b.makeConst(wasm::Literal(callReplacer.maxShadowStackOffset_))},
-                       wasm::Type::none),
+            b.makeCall(FnIncreaseSP, {b.makeConst(wasm::Literal(maxShadowStackOffset))}, wasm::Type::none),
             b.makeLocalGet(scratchReturnValueLocalIndex, resultType),
         },
         resultType);
-    ReturnWithResultReplacer returnReplacer{scratchReturnValueLocalIndex, callReplacer.maxShadowStackOffset_,
-                                            resultType};
+    ReturnWithResultReplacer returnReplacer{scratchReturnValueLocalIndex, maxShadowStackOffset, resultType};
     returnReplacer.walkFunctionInModule(func, m);
   }
+
+  if (elideFrameFill_ && isFrameAssignedBeforeCollection(func, stackPosition, maxShadowStackOffset, leaf_.get()))
+    decreaseSP->target = FnDecreaseSPWithoutFill;
 }
 
 struct PostLowering : public wasm::Pass {
   std::shared_ptr<gc::StackPositions> stackPosition_;
-  explicit PostLowering(std::shared_ptr<gc::StackPositions> stackPosition) : stackPosition_(stackPosition) {
+  bool withoutFillVariant_;
+  bool withoutCheckVariant_;
+  explicit PostLowering(std::shared_ptr<gc::StackPositions> stackPosition, bool withoutFillVariant,
+                        bool withoutCheckVariant)
+      : stackPosition_(stackPosition), withoutFillVariant_(withoutFillVariant),
+        withoutCheckVariant_(withoutCheckVariant) {
     name = "PostLowering";
   }
   bool modifiesBinaryenIR() override { return true; }
@@ -176,21 +325,36 @@ struct PostLowering : public wasm::Pass {
     wasm::Builder b{*m};
     wasm::Name const memoryName = m->memories.front()->name;
     wasm::Type const i32 = wasm::Type::i32;
-    m->addFunction(b.makeFunction(
-        "~lib/rt/__decrease_sp", wasm::Signature(i32, wasm::Type::none), {},
-        b.makeBlock({
-            b.makeGlobalSet(
-                VarStackPointer,
-                b.makeBinary(wasm::BinaryOp::SubInt32, b.makeGlobalGet(VarStackPointer, i32), b.makeLocalGet(0, i32))),
-            b.makeMemoryFill(b.makeGlobalGet(VarStackPointer, i32), b.makeConst(wasm::Literal::makeZero(i32)),
-                             b.makeLocalGet(0, i32), memoryName),
-            b.makeIf(b.makeBinary(wasm::BinaryOp::LtSInt32, b.makeGlobalGet(VarStackPointer, i32),
-                                  b.makeGlobalGet(VarDataEnd, i32)),
-                     b.makeUnreachable()),
-
-        })));
+    auto const makeStackCheck = [&](wasm::Expression *stackPointer) -> wasm::Expression * {
+      return b.makeIf(b.makeBinary(wasm::BinaryOp::LtSInt32, stackPointer, b.makeGlobalGet(VarDataEnd, i32)),
+                      b.makeUnreachable());
+    };
+    auto const makeDecreaseSP = [&](wasm::Name name, bool fill, bool check) {
+      std::vector<wasm::Expression *> items{b.makeGlobalSet(
+          VarStackPointer,
+          b.makeBinary(wasm::BinaryOp::SubInt32, b.makeGlobalGet(VarStackPointer, i32), b.makeLocalGet(0, i32)))};
+      if (fill)
+        items.push_back(b.makeMemoryFill(b.makeGlobalGet(VarStackPointer, i32),
+                                         b.makeConst(wasm::Literal::makeZero(i32)), b.makeLocalGet(0, i32),
+                                         memoryName));
+      if (check)
+        items.push_back(makeStackCheck(b.makeGlobalGet(VarStackPointer, i32)));
+      m->addFunction(b.makeFunction(name, wasm::Signature(i32, wasm::Type::none), {}, b.makeBlock(items)));
+    };
+    makeDecreaseSP(FnDecreaseSP, true, true);
+    if (withoutFillVariant_)
+      makeDecreaseSP(FnDecreaseSPWithoutFill, false, true);
+    if (withoutCheckVariant_) {
+      makeDecreaseSP(FnDecreaseSPWithoutCheck, true, false);
+      if (withoutFillVariant_)
+        makeDecreaseSP(FnDecreaseSPWithoutFillAndCheck, false, false);
+      m->addFunction(b.makeFunction(
+          FnCheckStack, wasm::Signature(i32, wasm::Type::none), {},
+          makeStackCheck(b.makeBinary(wasm::BinaryOp::SubInt32, b.makeGlobalGet(VarStackPointer, i32),
+                                      b.makeLocalGet(0, i32)))));
+    }
     m->addFunction(
-        b.makeFunction("~lib/rt/__increase_sp", wasm::Signature(i32, wasm::Type::none), {},
+        b.makeFunction(FnIncreaseSP, wasm::Signature(i32, wasm::Type::none), {},
                        b.makeBlock({
                            b.makeGlobalSet(VarStackPointer,
                                            b.makeBinary(wasm::BinaryOp::AddInt32, b.makeGlobalGet(VarStackPointer, i32),
@@ -223,8 +387,103 @@ private:
   }
 };
 
+/// @brief run analysis and lowering of one function in one task.
+/// @details SSA map, liveness, merging, leaf function filter, stack position assignment and lowering of a function
+/// run back to back while its data is still in cache. Its SSA map and liveness are freed right after, only stack
+/// positions are kept for PostLowering.
+struct FusedLowering : public wasm::Pass {
+  GCLowering::Config config_;
+  StackAssigner::Mode stackAssignerMode_;
+  std::shared_ptr<ManagedParams const> managedParams_;
+  /// @brief GC leaf functions, nullptr means every call may collect
+  std::shared_ptr<LeafFunc const> leaf_;
+  /// @brief GC leaf functions for LeafFunctionFilter
+  std::shared_ptr<LeafFunc const> filterLeaf_;
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets_;
+  std::shared_ptr<StackSlotStatistics> statistics_;
+  std::shared_ptr<StackPositions> stackPositions_;
+  FusedLowering(GCLowering::Config config, StackAssigner::Mode stackAssignerMode,
+                std::shared_ptr<ManagedParams const> managedParams, std::shared_ptr<LeafFunc const> leaf,
+                std::shared_ptr<LeafFunc const> filterLeaf,
+                std::shared_ptr<IndirectCallTargets const> indirectCallTargets,
+                std::shared_ptr<StackSlotStatistics> statistics, std::shared_ptr<StackPositions> stackPositions)
+      : config_(std::move(config)), stackAssignerMode_(stackAssignerMode), managedParams_(std::move(managedParams)),
+        leaf_(std::move(leaf)), filterLeaf_(std::move(filterLeaf)),
+        indirectCallTargets_(std::move(indirectCallTargets)), statistics_(std::move(statistics)),
+        stackPositions_(std::move(stackPositions)) {
+    name = "FusedLowering";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<FusedLowering>(config_, stackAssignerMode_, managedParams_, leaf_, filterLeaf_,
+                                           indirectCallTargets_, statistics_, stackPositions_);
+  }
+  bool modifiesBinaryenIR() override { return true; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override;
+
+  static std::shared_ptr<StackPositions>
+  addToPass(wasm::PassRunner &runner, GCLowering::Config const &config, StackAssigner::Mode stackAssignerMode,
+            std::shared_ptr<ManagedParams const> const &managedParams, std::shared_ptr<LeafFunc const> const &leaf,
+            std::shared_ptr<LeafFunc const> const &filterLeaf,
+            std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
+            std::shared_ptr<StackSlotStatistics> const &statistics) {
+    auto stackPositions = std::make_shared<StackPositions>(StackAssigner::createResults(runner.wasm));
+    runner.add(std::make_unique<FusedLowering>(config, stackAssignerMode, managedParams, leaf, filterLeaf,
+                                               indirectCallTargets, statistics, stackPositions));
+    return stackPositions;
+  }
+};
+
+void FusedLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
+  // analysis data of this function only, it is released when this task finishes
+  ModuleLevelSSAMap ssaMap{};
+  ssaMap.insert_or_assign(func, SSAMap::create(func, managedParams_.get()));
+  auto livenessInfo = std::make_shared<ObjLivenessInfo>();
+  livenessInfo->insert_or_assign(func, LivenessMap{});
+  auto stackPositions = std::make_shared<StackPositions>();
+  stackPositions->insert_or_assign(func, StackPosition{});
+
+  std::vector<std::unique_ptr<wasm::Pass>> passes{};
+  passes.push_back(std::make_unique<ObjLivenessAnalyzer>(ssaMap, livenessInfo));
+  if (config_.mergeSSA)
+    passes.push_back(std::make_unique<MergeSSA>(ssaMap, livenessInfo));
+  if (config_.leafFunctionFilter) {
+    assert(filterLeaf_ != nullptr);
+    passes.push_back(std::make_unique<LeafFunctionFilter>(filterLeaf_, indirectCallTargets_, livenessInfo));
+  }
+  passes.push_back(std::make_unique<StackAssigner>(stackAssignerMode_, stackPositions, livenessInfo, statistics_));
+  passes.push_back(std::make_unique<ToStackCallLowering>(stackPositions, config_.shrinkWrap ? livenessInfo : nullptr,
+                                                         leaf_, config_.elideFrameFill));
+  if (config_.lazyRootSpilling)
+    passes.push_back(std::make_unique<LazyRootSpilling>(stackPositions, leaf_));
+  if (config_.optimizeToStackStores)
+    passes.push_back(std::make_unique<ToStackStoreOptimizer>(stackPositions));
+
+  for (std::unique_ptr<wasm::Pass> const &pass : passes) {
+    pass->setPassRunner(getPassRunner());
+    pass->runOnFunction(m, func);
+  }
+  stackPositions_->at(func) = std::move(stackPositions->at(func));
+}
 } // namespace gc
 
+GCLowering::Config GCLowering::getDefaultConfig() {
+  return Config{
+      .leafFunctionFilter = !NoLeafFunctionFilter.get(),
+      .returningCollectionSummary = ReturningCollectionSummary.get(),
+      .mergeSSA = !NoMergeSSA.get(),
+      .optimizedStackPositionAssigner = !NoOptimizedStackPositionAssigner.get(),
+      .optimalStackPositionAssigner = OptimalStackPositionAssigner.get(),
+      .shrinkWrap = ShrinkWrap.get(),
+      .elideFrameFill = ElideFrameFill.get(),
+      .interproceduralStackCheck = InterproceduralStackCheck.get(),
+      .lazyRootSpilling = LazyRootSpilling.get(),
+      .optimizeToStackStores = OptimizeToStackStores.get(),
+      .fusedLowering = FusedLowering.get(),
+      .cacheDir = GCCacheDir.get(),
+  };
+}
+
 void GCLowering::preprocess(wasm::PassRunner &runner) {
   // cleanup without changing the overall code structure
   runner.add("vacuum");
@@ -233,7 +492,7 @@ void GCLowering::preprocess(wasm::PassRunner &runner) {
 }
 
 void GCLowering::run(wasm::Module *m) {
-  wasm::PassRunner runner{getPassRunner()};
+  gc::CachedFunctionSkippingRunner runner{getPassRunner()};
 
   preprocess(runner);
 
@@ -242,39 +501,215 @@ void GCLowering::run(wasm::Module *m) {
     return;
   }
 
-  gc::ModuleLevelSSAMap const moduleLevelSSAMap = gc::ModuleLevelSSAMap::create(m);
+  std::shared_ptr<gc::ManagedParams const> const managedParams = gc::ManagedParams::extract(*m);
+  // stack positions of all functions are needed before lowering by the cache and by the interprocedural stack depth
+  bool const fusedLowering = config_.fusedLowering && config_.cacheDir.empty() &&
+                             !config_.interproceduralStackCheck && !StackDepthReport.get();
+  gc::ModuleLevelSSAMap const moduleLevelSSAMap = [m, &managedParams, fusedLowering]() {
+    // fused lowering creates the SSA map of each function in its own task
+    if (fusedLowering)
+      return gc::ModuleLevelSSAMap{};
+    TimeReport::Scope const scope{"ModuleLevelSSAMap"};
+    return gc::ModuleLevelSSAMap::create(m, managedParams.get());
+  }();
+  // liveness analysis is proportional to expression count times SSA value count
+  if (fusedLowering) {
+    // SSA map is not built yet, local count is a cheap approximation of SSA value count
+    runner.setCostEstimator([](wasm::Function *func) -> size_t {
+      return estimateCostByExpressionCount(func) * (func->getNumLocals() + 1U);
+    });
+  } else {
+    runner.setCostEstimator([&moduleLevelSSAMap](wasm::Function *func) -> size_t {
+      auto const it = moduleLevelSSAMap.find(func);
+      size_t const ssaCount = it == moduleLevelSSAMap.end() ? 0U : it->second.size();
+      return estimateCostByExpressionCount(func) * (ssaCount + 1U);
+    });
+  }
 
-  std::shared_ptr<CallGraph const> cg = CallGraphBuilder::addToPass(runner);
+  std::shared_ptr<IndirectCallTargets const> const indirectCallTargets = IndirectCallTargets::create(*m);
+  std::shared_ptr<CallGraph const> cg = CallGraphBuilder::addToPass(runner, indirectCallTargets);
 
   std::shared_ptr<gc::LeafFunc> leafFunc;
-  if (!NoLeafFunctionFilter.get()) {
+  if (config_.leafFunctionFilter || config_.elideFrameFill || config_.lazyRootSpilling) {
     leafFunc = gc::LeafFunctionCollector::addToPass(runner, cg);
   }
+  // callers are never resumed after a collection on a path which does not return, so only the leaf function filter
+  // can ignore it. Frame fill elision and root spilling still need every collection.
+  std::shared_ptr<gc::LeafFunc> filterLeafFunc = leafFunc;
+  if (config_.leafFunctionFilter && config_.returningCollectionSummary)
+    filterLeafFunc = gc::LeafFunctionCollector::addToPass(
+        runner, gc::ReturningCallGraphBuilder::addToPass(runner, cg, indirectCallTargets));
+
+  gc::StackAssigner::Mode stackAssignerMode = gc::StackAssigner::Mode::Vanilla;
+  if (config_.optimizedStackPositionAssigner)
+    stackAssignerMode = config_.optimalStackPositionAssigner ? gc::StackAssigner::Mode::OptimalConflictGraph
+                                                             : gc::StackAssigner::Mode::GreedyConflictGraph;
+  std::shared_ptr<gc::StackSlotStatistics> stackSlotStatistics =
+      StackSlotReport.get() ? std::make_shared<gc::StackSlotStatistics>() : nullptr;
 
-  std::shared_ptr<gc::ObjLivenessInfo> livenessInfo = gc::ObjLivenessAnalyzer::addToPass(runner, moduleLevelSSAMap);
+  std::shared_ptr<gc::StackPositions> stackPositions;
+  std::shared_ptr<gc::StackDepths> stackDepths;
+  if (fusedLowering) {
+    stackPositions = gc::FusedLowering::addToPass(runner, config_, stackAssignerMode, managedParams, leafFunc,
+                                                  filterLeafFunc, indirectCallTargets, stackSlotStatistics);
+  } else {
+    std::shared_ptr<gc::StackPositionCacheEntries> cacheEntries;
+    if (!config_.cacheDir.empty()) {
+      std::string const configKey =
+          fmt::format("leaf-function-filter={} returning-collection-summary={} merge-ssa={} "
+                      "optimized-stack-position-assigner={} optimal-stack-position-assigner={}",
+                      config_.leafFunctionFilter, config_.returningCollectionSummary, config_.mergeSSA,
+                      config_.optimizedStackPositionAssigner, config_.optimalStackPositionAssigner);
+      cacheEntries =
+          gc::StackPositionCache::addLoadToPass(runner, config_.cacheDir, configKey, filterLeafFunc,
+                                                indirectCallTargets, managedParams);
+      // analysis below only runs on functions which are not cached
+      runner.setSkipping(cacheEntries);
+    }
+
+    std::shared_ptr<gc::ObjLivenessInfo> livenessInfo =
+        gc::ObjLivenessAnalyzer::addToPass(runner, moduleLevelSSAMap);
+
+    if (config_.mergeSSA) {
+      // targets of merging come from def-use chain, so it does not depend on LeafFunctionFilter. Merging before the
+      // filter lets the filter invalidate merged local SSA values as a whole.
+      gc::MergeSSA::addToPass(runner, moduleLevelSSAMap, livenessInfo);
+    }
 
-  if (!NoMergeSSA.get()) {
-    // now merge ssa should be done firstly, it is depends on liveness info as local's possible values.
-    // After LeafFunctionFilter, liveness info is not correct anymore.
-    // TODO: use def-uses chain instead of liveness info
-    gc::MergeSSA::addToPass(runner, moduleLevelSSAMap, livenessInfo);
+    if (config_.leafFunctionFilter) {
+      assert(filterLeafFunc != nullptr);
+      runner.add(
+          std::unique_ptr<wasm::Pass>(new gc::LeafFunctionFilter(filterLeafFunc, indirectCallTargets, livenessInfo)));
+    }
+
+    stackPositions = gc::StackAssigner::addToPass(runner, stackAssignerMode, livenessInfo, stackSlotStatistics);
+
+    if (cacheEntries != nullptr) {
+      runner.setSkipping(nullptr);
+      gc::StackPositionCache::addStoreToPass(runner, config_.cacheDir, cacheEntries, stackPositions);
+    }
+
+    if (config_.interproceduralStackCheck || StackDepthReport.get())
+      stackDepths = gc::StackDepthAnalyzer::addToPass(runner, cg, stackPositions);
+
+    runner.add(std::unique_ptr<wasm::Pass>(new gc::ToStackCallLowering(
+        stackPositions, config_.shrinkWrap ? livenessInfo : nullptr, leafFunc, config_.elideFrameFill)));
+    if (config_.interproceduralStackCheck)
+      runner.add(std::unique_ptr<wasm::Pass>(new gc::StackCheckLowering(stackDepths)));
+    if (config_.lazyRootSpilling)
+      runner.add(std::unique_ptr<wasm::Pass>(new gc::LazyRootSpilling(stackPositions, leafFunc)));
+    if (config_.optimizeToStackStores)
+      runner.add(std::unique_ptr<wasm::Pass>(new gc::ToStackStoreOptimizer(stackPositions)));
   }
+  runner.add(std::unique_ptr<wasm::Pass>(
+      new gc::PostLowering(stackPositions, config_.elideFrameFill, config_.interproceduralStackCheck)));
+
+  runner.run();
 
-  if (!NoLeafFunctionFilter.get()) {
-    assert(leafFunc != nullptr);
-    runner.add(std::unique_ptr<wasm::Pass>(new gc::LeafFunctionFilter(leafFunc, livenessInfo)));
+  if (stackSlotStatistics != nullptr) {
+    size_t const greedySlots = stackSlotStatistics->greedySlots;
+    size_t const assignedSlots = stackSlotStatistics->assignedSlots;
+    fmt::println(stderr, "GC stack slots: greedy {}, assigned {}, saved {} bytes in {} functions", greedySlots,
+                 assignedSlots, (greedySlots - assignedSlots) * gc::StackSlotStatistics::SlotSize,
+                 stackSlotStatistics->improvedFunctions.load());
+  }
+  if (StackDepthReport.get()) {
+    std::optional<uint32_t> const worstCaseDepth = gc::StackDepthAnalyzer::getWorstCaseDepth(*stackDepths);
+    if (worstCaseDepth.has_value())
+      fmt::println(stderr, "GC shadow stack depth: worst case {} bytes", worstCaseDepth.value());
+    else
+      fmt::println(stderr, "GC shadow stack depth: unbounded because of recursion");
   }
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+#include <string_view>
 
-  gc::StackAssigner::Mode const stackAssignerMode = NoOptimizedStackPositionAssigner.get()
-                                                        ? gc::StackAssigner::Mode::Vanilla
-                                                        : gc::StackAssigner::Mode::GreedyConflictGraph;
-  std::shared_ptr<gc::StackPositions> stackPositions =
-      gc::StackAssigner::addToPass(runner, stackAssignerMode, livenessInfo);
+#include "../Runner.hpp"
+#include "../helper/ToString.hpp"
+#include "LoweringTestHelper.hpp"
 
-  runner.add(std::unique_ptr<wasm::Pass>(new gc::ToStackCallLowering(stackPositions)));
-  runner.add(std::unique_ptr<wasm::Pass>(new gc::PostLowering(stackPositions)));
+namespace warpo::passes::ut {
 
+std::unique_ptr<wasm::Module> loadGCTestWat(std::string_view funcWat) {
+  // funcWat goes first, since imports must precede definitions
+  return loadWat(fmt::format(R"(
+    (module
+      {}
+      (memory 1)
+      (global $~lib/memory/__stack_pointer (mut i32) (i32.const 0))
+      (global $~lib/memory/__data_end i32 (i32.const 0))
+      (func $~lib/rt/__localtostack (param i32) (result i32)
+        local.get 0
+      )
+      (func $~lib/rt/__tmptostack (param i32) (result i32)
+        local.get 0
+      )
+      (func $~lib/rt/itcms/__new (result i32)
+        i32.const 0
+      )
+      (func $use (param i32 i32)
+      )
+    )
+  )",
+                             funcWat));
+}
+
+std::unique_ptr<wasm::Module> lowerGCTestWat(std::string_view funcWat, GCLowering::Config const &config) {
+  std::unique_ptr<wasm::Module> m = loadGCTestWat(funcWat);
+  wasm::PassRunner runner{m.get()};
+  runner.add(std::make_unique<GCLowering>(config));
   runner.run();
+  return m;
 }
 
-} // namespace warpo::passes
+size_t countToStackStores(wasm::Expression *expr) {
+  size_t count = 0U;
+  for (wasm::Call *call : wasm::FindAll<wasm::Call>(expr).list) {
+    if (call->target.startsWith("~lib/rt/__tostack<"))
+      count++;
+  }
+  return count;
+}
+
+namespace {
+
+std::vector<std::string> lowerFunctions(bool fusedLowering) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.fusedLowering = fusedLowering;
+  std::unique_ptr<wasm::Module> m = lowerGCTestWat(R"(
+    (func $f (param i32) (result i32)
+      (local i32)
+      (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (call $use (call $~lib/rt/__tmptostack (call $~lib/rt/itcms/__new)) (local.get 0))
+      (if (local.get 0)
+        (then (return (local.get 1)))
+      )
+      (drop (call $~lib/rt/itcms/__new))
+      local.get 1
+    )
+    (func $g (param i32)
+      (call $use (call $~lib/rt/__tmptostack (local.get 0)) (call $~lib/rt/itcms/__new))
+    )
+  )",
+                                                   config);
+  return {toString(m->getFunction("f")), toString(m->getFunction("g"))};
+}
+
+} // namespace
+
+TEST(GCLoweringTest, FusedLoweringSameResult) {
+  std::vector<std::string> const staged = lowerFunctions(false);
+  std::vector<std::string> const fused = lowerFunctions(true);
+  EXPECT_EQ(staged, fused);
+  EXPECT_NE(fused[0].find("__tostack<"), std::string::npos);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include "pass.h"
 #include "wasm.h"
 
@@ -7,11 +9,44 @@ namespace warpo::passes {
 
 /// @brief lowering tostack function
 struct GCLowering : public wasm::Pass {
-  explicit GCLowering() { name = "GCLowering"; }
+  /// @brief switches of sub passes
+  struct Config {
+    bool leafFunctionFilter;
+    /// @brief leaf function filter ignores collections on paths which never return to the caller
+    bool returningCollectionSummary;
+    bool mergeSSA;
+    bool optimizedStackPositionAssigner;
+    /// @brief minimize shadow stack slots instead of greedy coloring, only used with optimizedStackPositionAssigner
+    bool optimalStackPositionAssigner;
+    /// @brief set up shadow stack frame only around the region which stores to shadow stack
+    bool shrinkWrap;
+    /// @brief skip zero filling shadow stack frame when every slot is stored before any possible collection
+    bool elideFrameFill;
+    /// @brief check shadow stack overflow once per non-recursive call tree instead of per frame
+    bool interproceduralStackCheck;
+    /// @brief sink tostack stores of locals to the first possible collection on each path
+    bool lazyRootSpilling;
+    /// @brief hoist loop invariant tostack stores and remove stores whose slot already holds the value
+    bool optimizeToStackStores;
+    /// @brief run analysis and lowering of each function in one parallel task and free its analysis data afterwards.
+    /// It is ignored when cacheDir or interproceduralStackCheck is used, since they need stack positions of all
+    /// functions before lowering.
+    bool fusedLowering;
+    /// @brief directory of the on-disk stack position cache, empty means disabled
+    std::string cacheDir;
+  };
+  /// @brief config from command line options
+  static Config getDefaultConfig();
+
+  explicit GCLowering() : GCLowering(getDefaultConfig()) {}
+  explicit GCLowering(Config const &config) : config_(config) { name = "GCLowering"; }
   void run(wasm::Module *m) override;
 
   // preprocess pass for testing
   static void preprocess(wasm::PassRunner &runner);
+
+private:
+  Config config_;
 };
 
 } // namespace warpo::passes
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+#include "Lowering.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::ut {
+
+/// @brief load `funcWat` in a module with memory, shadow stack globals, tostack functions, `__new` and
+/// `$use (param i32 i32)`.
+std::unique_ptr<wasm::Module> loadGCTestWat(std::string_view funcWat);
+
+/// @brief load `funcWat` by loadGCTestWat and run GCLowering with `config`.
+std::unique_ptr<wasm::Module> lowerGCTestWat(std::string_view funcWat, GCLowering::Config const &config);
+
+/// @brief count of `__tostack<{offset}>` calls in `expr`.
+size_t countToStackStores(wasm::Expression *expr);
+
+} // namespace warpo::passes::ut
+
+#endif
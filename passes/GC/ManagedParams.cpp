@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ManagedParams.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+namespace {
+
+struct SectionReader {
+  std::vector<char> const &data_;
+  size_t pos_ = 0U;
+
+  bool isEnd() const { return pos_ == data_.size(); }
+  uint32_t readU32LEB() {
+    uint32_t value = 0U;
+    for (uint32_t shift = 0U; shift < 35U; shift += 7U) {
+      if (isEnd())
+        throw std::invalid_argument{fmt::format("invalid {} section: unexpected end", ManagedParams::SectionName)};
+      uint8_t const byte = static_cast<uint8_t>(data_[pos_++]);
+      value |= static_cast<uint32_t>(byte & 0x7FU) << shift;
+      if ((byte & 0x80U) == 0U)
+        return value;
+    }
+    throw std::invalid_argument{fmt::format("invalid {} section: LEB128 too long", ManagedParams::SectionName)};
+  }
+  std::string readString() {
+    uint32_t const size = readU32LEB();
+    if (size > data_.size() - pos_)
+      throw std::invalid_argument{fmt::format("invalid {} section: unexpected end", ManagedParams::SectionName)};
+    std::string str{data_.begin() + static_cast<std::ptrdiff_t>(pos_),
+                    data_.begin() + static_cast<std::ptrdiff_t>(pos_ + size)};
+    pos_ += size;
+    return str;
+  }
+};
+
+} // namespace
+
+std::shared_ptr<ManagedParams const> ManagedParams::extract(wasm::Module &m) {
+  auto const it = std::find_if(m.customSections.begin(), m.customSections.end(),
+                               [](wasm::CustomSection const &section) { return section.name == SectionName; });
+  if (it == m.customSections.end())
+    return nullptr;
+  auto ret = std::make_shared<ManagedParams>();
+  SectionReader reader{it->data};
+  while (!reader.isEnd()) {
+    wasm::Name const func{reader.readString()};
+    std::set<wasm::Index> &params = ret->params_[func];
+    uint32_t const count = reader.readU32LEB();
+    for (uint32_t i = 0U; i < count; i++)
+      params.insert(reader.readU32LEB());
+  }
+  // the section is only for GC lowering and should not be emitted
+  m.customSections.erase(it);
+  return ret;
+}
+
+bool ManagedParams::mayBeManaged(wasm::Name func, wasm::Index paramIndex) const {
+  std::set<wasm::Index> const *params = get(func);
+  return params == nullptr || params->contains(paramIndex);
+}
+
+std::set<wasm::Index> const *ManagedParams::get(wasm::Name func) const {
+  auto const it = params_.find(func);
+  return it == params_.end() ? nullptr : &it->second;
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+
+#include "../Runner.hpp"
+#include "LoweringTestHelper.hpp"
+#include "SSAObj.hpp"
+#include "wasm-binary.h"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+void addManagedParamsSection(wasm::Module &m, std::vector<char> data) {
+  wasm::CustomSection section{};
+  section.name = gc::ManagedParams::SectionName;
+  section.data = std::move(data);
+  m.customSections.push_back(std::move(section));
+}
+
+} // namespace
+
+TEST(GCManagedParamsTest, ExcludeUnmanagedParams) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (param i32 i32 i32)
+        (drop (local.get 0))
+      )
+      (func $g (param i32 i32)
+        (drop (local.get 0))
+      )
+    )
+  )");
+  // $f: param 1 is managed, $g is unknown
+  addManagedParamsSection(*m, {1, 'f', 1, 1});
+
+  std::shared_ptr<gc::ManagedParams const> managedParams = gc::ManagedParams::extract(*m);
+  ASSERT_NE(managedParams, nullptr);
+  EXPECT_TRUE(m->customSections.empty());
+  EXPECT_TRUE(managedParams->isKnown("f"));
+  EXPECT_FALSE(managedParams->isKnown("g"));
+
+  gc::SSAMap const f = gc::SSAMap::create(m->getFunction("f"), managedParams.get());
+  EXPECT_EQ(f.size(), 1U);
+  EXPECT_TRUE(f.contains(gc::SSAValue{static_cast<wasm::Index>(1)}));
+  gc::SSAMap const g = gc::SSAMap::create(m->getFunction("g"), managedParams.get());
+  EXPECT_EQ(g.size(), 2U);
+}
+
+namespace {
+
+/// @brief binary handoff from asc, which keeps names since runtime functions are recognized by name.
+std::unique_ptr<wasm::Module> reloadFromBinary(wasm::Module &m) {
+  wasm::BufferWithRandomAccess buffer;
+  wasm::WasmBinaryWriter writer(&m, buffer, wasm::PassOptions::getWithoutOptimization());
+  writer.setNamesSection(true);
+  writer.write();
+  return loadWasm(std::vector<char>{buffer.begin(), buffer.end()});
+}
+
+} // namespace
+
+TEST(GCManagedParamsTest, UnmanagedParamIsDroppedAfterBinaryHandoff) {
+  std::unique_ptr<wasm::Module> m = loadGCTestWat(R"(
+    (func $f (param i32 i32)
+      (call $use (call $~lib/rt/__tmptostack (local.get 0)) (call $~lib/rt/itcms/__new))
+      (call $use (local.get 1) (i32.const 0))
+    )
+  )");
+  // $f: param 0 is managed, param 1 is an integer
+  addManagedParamsSection(*m, {1, 'f', 1, 0});
+
+  std::unique_ptr<wasm::Module> const analyzed = reloadFromBinary(*m);
+  std::shared_ptr<gc::ManagedParams const> managedParams = gc::ManagedParams::extract(*analyzed);
+  ASSERT_NE(managedParams, nullptr);
+  gc::SSAMap const f = gc::SSAMap::create(analyzed->getFunction("f"), managedParams.get());
+  EXPECT_TRUE(f.contains(gc::SSAValue{static_cast<wasm::Index>(0)}));
+  EXPECT_FALSE(f.contains(gc::SSAValue{static_cast<wasm::Index>(1)}));
+
+  std::unique_ptr<wasm::Module> const lowered = reloadFromBinary(*m);
+  wasm::PassRunner runner{lowered.get()};
+  runner.add(std::make_unique<GCLowering>(GCLowering::getDefaultConfig()));
+  runner.run();
+  EXPECT_TRUE(lowered->customSections.empty());
+  // the tmp aliases param 0, which is kept alive by the caller
+  EXPECT_EQ(countToStackStores(lowered->getFunction("f")->body), 0U);
+}
+
+TEST(GCManagedParamsTest, NoSection) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (param i32))
+    )
+  )");
+  EXPECT_EQ(gc::ManagedParams::extract(*m), nullptr);
+}
+
+TEST(GCManagedParamsTest, TruncatedSection) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (param i32))
+    )
+  )");
+  addManagedParamsSection(*m, {1, 'f', 2, 0});
+  EXPECT_THROW(gc::ManagedParams::extract(*m), std::invalid_argument);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string_view>
+
+#include "support/name.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief params of each function which hold managed references, recorded by AS compiler in custom section.
+/// @details section format is a sequence of `<name size> <name> <param count> <param index>...` in unsigned LEB128.
+/// Locals are not recorded, because only managed locals are set by `__localtostack`. Functions which are not recorded
+/// are unknown, all their i32 params may hold managed references.
+class ManagedParams {
+  std::map<wasm::Name, std::set<wasm::Index>> params_;
+
+public:
+  static constexpr std::string_view SectionName = "warpo.managed_params";
+
+  /// @brief parse and remove the custom section, nullptr if module does not have it.
+  static std::shared_ptr<ManagedParams const> extract(wasm::Module &m);
+
+  bool isKnown(wasm::Name func) const { return params_.contains(func); }
+  /// @brief false only when param is known to hold no managed reference.
+  bool mayBeManaged(wasm::Name func, wasm::Index paramIndex) const;
+  /// @brief managed params of known function, nullptr for unknown function.
+  std::set<wasm::Index> const *get(wasm::Name func) const;
+};
+
+} // namespace warpo::passes::gc
@@ -1,88 +1,77 @@
-#include <cassert>
 #include <cstddef>
-#include <map>
+#include <optional>
+#include <vector>
 
+#include "../helper/DefUseChain.hpp"
 #include "MergeSSA.hpp"
 #include "SSAObj.hpp"
 #include "support/DynBitSet.hpp"
-#include "support/Range.hpp"
-#include "support/index.h"
 #include "wasm.h"
 
 namespace warpo::passes::gc {
 
-class LocalIndexToSSA : private std::map<wasm::Index, DynBitset> {
-  size_t size_;
+namespace {
 
-  void push(wasm::Index localIndex, size_t ssaIndex) {
-    auto it = this->try_emplace(localIndex, DynBitset{size_}).first;
-    it->second.set(ssaIndex, true);
-  }
-  explicit LocalIndexToSSA(size_t size) : size_(size) {}
+/// @brief SSA value of definition, nullopt when the definition is not tracked as GC object
+std::optional<size_t> getDefSSAIndex(wasm::Function *func, SSAMap const &ssaMap, DefUseChain const &chain,
+                                     DefUseChain::DefIndex defIndex) {
+  wasm::LocalSet *const set = chain.getDef(defIndex);
+  SSAValue value{};
+  if (set != nullptr)
+    value = SSAValue{set};
+  else if (defIndex < func->getNumParams())
+    value = SSAValue{static_cast<wasm::Index>(defIndex)};
+  else
+    return std::nullopt; // zero initialized var is null
+  if (!ssaMap.contains(value))
+    return std::nullopt;
+  return ssaMap.getIndex(value);
+}
 
-public:
-  static LocalIndexToSSA create(SSAMap const &ssaMap) {
-    LocalIndexToSSA ret{ssaMap.size()};
-    for (auto const &[ssa, ssaIndex] : ssaMap) {
-      std::optional<wasm::Index> localIndex = ssa.tryGetLocalIndex();
-      if (localIndex.has_value()) {
-        ret.push(localIndex.value(), ssaIndex);
-      }
-    }
-    return ret;
-  }
-  DynBitset const &get(wasm::Index localIndex) const {
-    auto it = this->find(localIndex);
-    assert(it != this->end());
-    return it->second;
-  }
-};
+} // namespace
 
 void MergeSSA::runOnFunction(wasm::Module *m, wasm::Function *func) {
   SSAMap const &ssaMap = moduleLevelSSAMap_.at(func);
   LivenessMap &livenessMap = info_->at(func);
-  size_t const ssaCount = ssaMap.size();
-  LocalIndexToSSA const localIndexToSSA = LocalIndexToSSA::create(ssaMap);
-  DynBitset invalidSSA{ssaCount};
+  DefUseChain const chain = DefUseChain::create(func);
+  DynBitset invalidSSA{ssaMap.size()};
 
   for (auto const &[ssa, tmpSSAIndex] : ssaMap) {
     if (ssa.kind_ != SSAValue::Kind::Tmp)
       continue;
     wasm::Call *const callExpr = ssa.value_.tmp;
+    auto *const getExpr = callExpr->operands[0]->dynCast<wasm::LocalGet>();
+    if (getExpr == nullptr || livenessMap.isInvalid(tmpSSAIndex))
+      continue;
 
-    if (auto *const getExpr = callExpr->operands[0]->dynCast<wasm::LocalGet>()) {
-      // this tmp ssa is reference of local
-      wasm::Index const localIndex = getExpr->index;
-      Liveness const localgetLiveness = livenessMap.getLiveness(getExpr).value();
-
-      DynBitset const localMappedSSA = localIndexToSSA.get(localIndex);
-      DynBitset const livenessBeforeLocalGet = localgetLiveness.before() & localMappedSSA;
-      DynBitset const livenessAfterLocalGet = localgetLiveness.after() & localMappedSSA;
-
-      assert(livenessBeforeLocalGet >= livenessAfterLocalGet && "local.get should kill liveness");
+    // this tmp ssa is reference of local, it aliases the local ssa values which reach the local.get
+    std::vector<size_t> targets{};
+    bool hasInvalidTarget = false;
+    for (DefUseChain::DefIndex const defIndex : chain.getReachingDefs(getExpr)) {
+      std::optional<size_t> const target = getDefSSAIndex(func, ssaMap, chain, defIndex);
+      if (!target.has_value())
+        continue;
+      targets.push_back(target.value());
+      hasInvalidTarget |= livenessMap.isInvalid(target.value());
+    }
+    // local ssa which is not stored to shadow stack cannot hold the tmp, e.g. after LeafFunctionFilter
+    if (targets.empty() || hasInvalidTarget)
+      continue;
 
-      // ;; 1_0 => 1_0 livenessBeforeLocalGet
-      // local.get
-      // ;; 0_0 => 1_0 livenessAfterLocalGet
-      // call $tostack
-      // ;; 0_1 => 1_1(invalid)
-      bool hasTarget = false;
-      // we extend the tmp ssa to the local ssa
-      for (size_t const target : Range{ssaCount}) {
-        if (livenessBeforeLocalGet.get(target)) {
-          hasTarget = true;
-          // because liveness for tmp will be active in call opcode. we should manually set the liveness
-          livenessMap.set(getExpr, LivenessMap::Pos::After, target, true);
-          livenessMap.set(callExpr, LivenessMap::Pos::Before, target, true);
-          livenessMap.mergeByColumns(target, tmpSSAIndex, LivenessMap::MergeOperator::OR);
-        }
-      }
-      // local call be invalidate before local.get when enabling other optimization
-      if (hasTarget) {
-        invalidSSA.set(tmpSSAIndex, true);
-      }
+    // ;; 1_0 => 1_0
+    // local.get
+    // ;; 0_0 => 1_0
+    // call $tostack
+    // ;; 0_1 => 1_1(invalid)
+    for (size_t const target : targets) {
+      // because liveness for tmp will be active in call opcode. we should manually set the liveness
+      livenessMap.set(getExpr, LivenessMap::Pos::After, target, true);
+      livenessMap.set(callExpr, LivenessMap::Pos::Before, target, true);
+      livenessMap.mergeByColumns(target, tmpSSAIndex, LivenessMap::MergeOperator::OR);
     }
-    livenessMap.setInvalid(invalidSSA);
+    invalidSSA.set(tmpSSAIndex, true);
   }
+  livenessMap.setInvalid(invalidSSA);
 }
+
 } // namespace warpo::passes::gc
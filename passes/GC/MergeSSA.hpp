@@ -7,7 +7,9 @@
 
 namespace warpo::passes::gc {
 
-/// @brief remove item in liveness which does not involve GC non leaf function
+/// @brief merge `__tmptostack(local.get $x)` into the local SSA values of `$x` which reach the local.get.
+/// @details reaching definitions come from DefUseChain instead of liveness, so it can run before or after
+/// LeafFunctionFilter. A tmp is only merged when all its targets are still stored to shadow stack.
 struct MergeSSA : public wasm::Pass {
   std::shared_ptr<ObjLivenessInfo> info_;
   ModuleLevelSSAMap const &moduleLevelSSAMap_;
@@ -11,13 +11,10 @@
 #include <vector>
 
 #include "../helper/CFG.hpp"
-#include "../helper/Powerset.hpp"
+#include "../helper/GenKillDataflow.hpp"
 #include "GCInfo.hpp"
 #include "ObjLivenessAnalyzer.hpp"
 #include "SSAObj.hpp"
-#include "analysis/cfg.h"
-#include "analysis/monotone-analyzer.h"
-#include "analysis/visitor-transfer-function.h"
 #include "support/Debug.hpp"
 #include "support/DynBitSet.hpp"
 #include "support/MultipleMap.hpp"
@@ -53,69 +50,62 @@ struct LocalToSSALookupTable : private std::map<size_t, std::vector<size_t>> {
 
 /// @brief which value is used in LocalGet
 struct LocalsUses : private MultipleMap<wasm::LocalGet *, size_t> {
-  static LocalsUses create(wasm::Function *func, SSAMap const &ssaMap, wasm::analysis::CFG &cfg);
+  static LocalsUses create(wasm::Function *func, SSAMap const &ssaMap, CFG const &cfg);
   using S = MultipleMap<wasm::LocalGet *, size_t>;
   using S::at;
   using S::begin;
   using S::contains;
   using S::end;
   using S::insert_or_assign;
-
-private:
-  friend class LiveLocalTransferFn;
 };
 
+DynBitset getParamsBoundary(wasm::Function *func, SSAMap const &ssaMap) {
+  DynBitset boundary{ssaMap.size()};
+  for (wasm::Index paramIndex : Range{func->getNumParams()}) {
+    SSAValue const value{paramIndex};
+    if (ssaMap.contains(value)) {
+      boundary.set(ssaMap.getIndex(value), true);
+    }
+  }
+  return boundary;
+}
+
 /// @brief forward analysis to find out which SSA is lived.
-class LiveLocalTransferFn : public wasm::analysis::VisitorTransferFunc<LiveLocalTransferFn, FiniteIntPowersetLattice,
-                                                                       wasm::analysis::AnalysisDirection::Forward> {
-  using S = wasm::analysis::VisitorTransferFunc<LiveLocalTransferFn, FiniteIntPowersetLattice,
-                                                wasm::analysis::AnalysisDirection::Forward>;
+class LiveLocalTransferFn : public IGenKillTransfer {
   SSAMap const &ssaMap_;
   LocalsUses &uses_;
   LocalToSSALookupTable localToSSA_;
 
-  static bool isActive(FiniteIntPowersetLattice::Element &s, size_t index) { return s.get(index) == true; }
-  static void setActive(FiniteIntPowersetLattice::Element &s, size_t index) { s.set(index, true); }
-  static void setInactive(FiniteIntPowersetLattice::Element &s, size_t index) { s.set(index, false); }
-
 public:
-  FiniteIntPowersetLattice lattice_;
-
-  explicit LiveLocalTransferFn(wasm::Function *func, SSAMap const &ssaMap, LocalsUses &uses)
-      : S{}, lattice_(ssaMap.size()), ssaMap_(ssaMap), uses_(uses), localToSSA_(LocalToSSALookupTable::create(ssaMap)) {
-  }
-
-  void evaluateFunctionEntry(wasm::Function *func, FiniteIntPowersetLattice::Element &element) {
-    for (wasm::Index paramIndex : Range{func->getNumParams()}) {
-      if (func->getParams()[paramIndex] == wasm::Type::i32) {
-        setActive(element, ssaMap_.getIndex(SSAValue{paramIndex}));
-      }
+  explicit LiveLocalTransferFn(SSAMap const &ssaMap, LocalsUses &uses)
+      : ssaMap_(ssaMap), uses_(uses), localToSSA_(LocalToSSALookupTable::create(ssaMap)) {}
+
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    if (auto *set = expr->dynCast<wasm::LocalSet>()) {
+      for (size_t const index : localToSSA_.getSSAMapIndexs(set->index))
+        effect.kill(index);
+      SSAValue const value{set};
+      if (ssaMap_.contains(value))
+        effect.gen(ssaMap_.getIndex(value));
     }
   }
-  void visitLocalGet(wasm::LocalGet *expr) {
-    if (collectingResults) {
-      for (size_t const index : localToSSA_.getSSAMapIndexs(expr->index)) {
-        if (isActive(*currState, index))
-          uses_.insert_or_assign(expr, index);
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    if (auto *get = expr->dynCast<wasm::LocalGet>()) {
+      for (size_t const index : localToSSA_.getSSAMapIndexs(get->index)) {
+        if (state.get(index))
+          uses_.insert_or_assign(get, index);
       }
     }
   }
-  void visitLocalSet(wasm::LocalSet *expr) {
-    for (size_t const index : localToSSA_.getSSAMapIndexs(expr->index))
-      setInactive(*currState, index);
-    SSAValue const value{expr};
-    if (ssaMap_.contains(value))
-      setActive(*currState, ssaMap_.getIndex(value));
-  }
 };
 
-LocalsUses LocalsUses::create(wasm::Function *func, SSAMap const &ssaMap, wasm::analysis::CFG &cfg) {
+LocalsUses LocalsUses::create(wasm::Function *func, SSAMap const &ssaMap, CFG const &cfg) {
   LocalsUses uses;
-  LiveLocalTransferFn transfer{func, ssaMap, uses};
-  using Analyzer = wasm::analysis::MonotoneCFGAnalyzer<FiniteIntPowersetLattice, LiveLocalTransferFn>;
-  Analyzer analyzer{transfer.lattice_, transfer, cfg};
-  analyzer.evaluateFunctionEntry(func);
-  analyzer.evaluateAndCollectResults();
+  LiveLocalTransferFn transfer{ssaMap, uses};
+  GenKillDataflow dataflow{cfg, ssaMap.size(), DataflowDirection::Forward, transfer};
+  dataflow.setBoundary(getParamsBoundary(func, ssaMap));
+  dataflow.solve();
+  dataflow.collectResults();
   return uses;
 }
 
@@ -165,147 +155,100 @@ TmpUses TmpUses::create(wasm::Function *func, SSAMap const &ssaMap) {
   return tmpUses;
 }
 
-class SSALivenessForwardTFn
-    : public wasm::analysis::VisitorTransferFunc<SSALivenessForwardTFn, FiniteIntPowersetLattice,
-                                                 wasm::analysis::AnalysisDirection::Forward> {
-  using S = wasm::analysis::VisitorTransferFunc<SSALivenessForwardTFn, FiniteIntPowersetLattice,
-                                                wasm::analysis::AnalysisDirection::Forward>;
+void recordLiveness(LivenessMap &livenessMap, wasm::Expression *expr, LivenessMap::Pos pos, DynBitset const &state) {
+  std::optional<size_t> const base = livenessMap.getIndexBase(expr);
+  if (!base.has_value())
+    return;
+  // each program point is collected once, only live SSA values need to be recorded.
+  state.forEachSetBit([&](size_t index) { livenessMap.set(base.value(), pos, index, true); });
+}
+
+class SSALivenessForwardTFn : public IGenKillTransfer {
   SSAMap const &ssaMap_;
   LivenessMap &livenessMap_;
 
-  bool isActive(size_t index) { return currState->get(index) == true; }
-  void setActive(size_t index) { currState->set(index, true); }
-
 public:
-  FiniteIntPowersetLattice lattice_;
   explicit SSALivenessForwardTFn(SSAMap const &ssaMap, LivenessMap &livenessMap)
-      : ssaMap_(ssaMap), livenessMap_(livenessMap), lattice_(ssaMap.size()) {}
-
-  void evaluateFunctionEntry(wasm::Function *func, FiniteIntPowersetLattice::Element &element) {
-    currState = &element;
-    for (wasm::Index paramIndex : Range{func->getNumParams()}) {
-      if (func->getParams()[paramIndex] == wasm::Type::i32) {
-        // parameters
-        setActive(ssaMap_.getIndex(SSAValue{paramIndex}));
-      }
-    }
-    currState = nullptr;
-  }
+      : ssaMap_(ssaMap), livenessMap_(livenessMap) {}
 
-  void visitLocalSet(wasm::LocalSet *expr) {
-    // local
-    if (ssaMap_.contains(SSAValue{expr}))
-      setActive(ssaMap_.getIndex(SSAValue{expr}));
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    // local and tmp
+    std::optional<size_t> const index = ssaMap_.tryGetIndexFromExpr(expr);
+    if (index.has_value())
+      effect.gen(index.value());
   }
-  void visitCall(wasm::Call *expr) {
-    // tmp
-    if (ssaMap_.contains(SSAValue{expr}))
-      setActive(ssaMap_.getIndex(SSAValue{expr}));
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    recordLiveness(livenessMap_, expr, LivenessMap::Pos::Before, state);
   }
-
-  void visit(wasm::Expression *expr) {
-    if (collectingResults && livenessMap_.getExprMap().contains(expr)) {
-      size_t const base = livenessMap_.getIndexBase(expr).value();
-      for (size_t index : Range{ssaMap_.size()})
-        livenessMap_.set(base, LivenessMap::Pos::Before, index, isActive(index));
-      S::visit(expr);
-      for (size_t index : Range{ssaMap_.size()})
-        livenessMap_.set(base, LivenessMap::Pos::After, index, isActive(index));
-    } else {
-      S::visit(expr);
-    }
+  void afterTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    recordLiveness(livenessMap_, expr, LivenessMap::Pos::After, state);
   }
 };
 
-class SSALivenessBackwardTFn
-    : public wasm::analysis::VisitorTransferFunc<SSALivenessBackwardTFn, FiniteIntPowersetLattice,
-                                                 wasm::analysis::AnalysisDirection::Backward> {
-  using S = wasm::analysis::VisitorTransferFunc<SSALivenessBackwardTFn, FiniteIntPowersetLattice,
-                                                wasm::analysis::AnalysisDirection::Backward>;
+class SSALivenessBackwardTFn : public IGenKillTransfer {
   SSAMap const &ssaMap_;
   LocalsUses const &localUses_;
   TmpUses const &tmpUses_;
   LivenessMap &livenessMap_;
 
-  bool isActive(size_t index) const { return currState->get(index) == true; }
-  void setActive(size_t index) { currState->set(index, true); }
-  void setInactive(size_t index) { currState->set(index, false); }
-
-  void visitImpl(wasm::Expression *expr) {
-    handleTmpUses(expr);
-    S::visit(expr);
-  }
-  void handleTmpUses(wasm::Expression *expr) {
-    if (tmpUses_.contains(expr))
-      for (size_t const index : tmpUses_.at(expr))
-        setActive(index);
-  }
-
 public:
-  FiniteIntPowersetLattice lattice_;
   explicit SSALivenessBackwardTFn(SSAMap const &ssaMap, LocalsUses const &localUses, TmpUses const &tmpUses,
                                   LivenessMap &livenessMap)
-      : ssaMap_(ssaMap), localUses_(localUses), tmpUses_(tmpUses), livenessMap_(livenessMap), lattice_(ssaMap.size()) {}
-
-  void evaluateFunctionExit(wasm::Function *func, FiniteIntPowersetLattice::Element &element) {
-    currState = &element;
-    handleTmpUses(nullptr);
-    currState = nullptr;
+      : ssaMap_(ssaMap), localUses_(localUses), tmpUses_(tmpUses), livenessMap_(livenessMap) {}
+
+  DynBitset getExitBoundary() const {
+    DynBitset boundary{ssaMap_.size()};
+    if (tmpUses_.contains(nullptr))
+      for (size_t const index : tmpUses_.at(nullptr))
+        boundary.set(index, true);
+    return boundary;
   }
 
-  void visitLocalGet(wasm::LocalGet *expr) {
-    if (localUses_.contains(expr))
-      for (size_t const &index : localUses_.at(expr))
-        setActive(index);
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    if (tmpUses_.contains(expr))
+      for (size_t const index : tmpUses_.at(expr))
+        effect.gen(index);
+    if (auto *get = expr->dynCast<wasm::LocalGet>()) {
+      if (localUses_.contains(get))
+        for (size_t const &index : localUses_.at(get))
+          effect.gen(index);
+      return;
+    }
+    // local and tmp
+    std::optional<size_t> const index = ssaMap_.tryGetIndexFromExpr(expr);
+    if (index.has_value())
+      effect.kill(index.value());
   }
-  void visitLocalSet(wasm::LocalSet *expr) {
-    // local
-    if (ssaMap_.contains(SSAValue{expr}))
-      setInactive(ssaMap_.getIndex(SSAValue{expr}));
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    recordLiveness(livenessMap_, expr, LivenessMap::Pos::After, state);
   }
-  void visitCall(wasm::Call *expr) {
-    // tmp
-    if (ssaMap_.contains(SSAValue{expr}))
-      setInactive(ssaMap_.getIndex(SSAValue{expr}));
-  }
-
-  void visit(wasm::Expression *expr) {
-    if (collectingResults && livenessMap_.getExprMap().contains(expr)) {
-      size_t const base = livenessMap_.getIndexBase(expr).value();
-      for (size_t index : Range{ssaMap_.size()})
-        livenessMap_.set(base, LivenessMap::Pos::After, index, isActive(index));
-      visitImpl(expr);
-      for (size_t index : Range{ssaMap_.size()})
-        livenessMap_.set(base, LivenessMap::Pos::Before, index, isActive(index));
-    } else {
-      visitImpl(expr);
-    }
+  void afterTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    recordLiveness(livenessMap_, expr, LivenessMap::Pos::Before, state);
   }
 };
-static void updateLivenessInfo(wasm::Function *func, LivenessMap &livenessMap, LocalsUses const &localUses,
-                               TmpUses const &tmpUses, SSAMap const &ssaMap, wasm::analysis::CFG &cfg) {
-  SSALivenessForwardTFn forwardFn{ssaMap, livenessMap};
-  using ForwardAnalyzer = wasm::analysis::MonotoneCFGAnalyzer<FiniteIntPowersetLattice, SSALivenessForwardTFn>;
-  ForwardAnalyzer forwardAnalyzer{forwardFn.lattice_, forwardFn, cfg};
-  forwardAnalyzer.evaluateFunctionEntry(func);
-  forwardAnalyzer.evaluateAndCollectResults();
-  // reset liveness map
-  DynBitset const forwardBitSet = std::move(livenessMap.storage_);
-  livenessMap.storage_ = DynBitset{forwardBitSet.size()};
+
+void updateLivenessInfo(wasm::Function *func, LivenessMap &livenessMap, LocalsUses const &localUses,
+                        TmpUses const &tmpUses, SSAMap const &ssaMap, CFG const &cfg) {
+  LivenessMap forwardLivenessMap = livenessMap;
+  SSALivenessForwardTFn forwardFn{ssaMap, forwardLivenessMap};
+  GenKillDataflow forwardDataflow{cfg, ssaMap.size(), DataflowDirection::Forward, forwardFn};
+  forwardDataflow.setBoundary(getParamsBoundary(func, ssaMap));
+  forwardDataflow.solve();
+  forwardDataflow.collectResults();
 
   if (support::isDebug(PASS_NAME, func->name.str)) {
-    std::cout << "forwardBitSet " << forwardBitSet << "\n";
+    std::cout << "forward liveness\n" << forwardLivenessMap;
   }
   SSALivenessBackwardTFn backwardFn{ssaMap, localUses, tmpUses, livenessMap};
-  using BackwardAnalyzer = wasm::analysis::MonotoneCFGAnalyzer<FiniteIntPowersetLattice, SSALivenessBackwardTFn>;
-  BackwardAnalyzer backwardAnalyzer{backwardFn.lattice_, backwardFn, cfg};
-  backwardAnalyzer.evaluateFunctionExit(func);
-  backwardAnalyzer.evaluateAndCollectResults();
+  GenKillDataflow backwardDataflow{cfg, ssaMap.size(), DataflowDirection::Backward, backwardFn};
+  backwardDataflow.setBoundary(backwardFn.getExitBoundary());
+  backwardDataflow.solve();
+  backwardDataflow.collectResults();
 
   if (support::isDebug(PASS_NAME, func->name.str)) {
-    std::cout << "backwardBitSet " << livenessMap.storage_ << "\n";
+    std::cout << "backward liveness\n" << livenessMap;
   }
-  livenessMap.storage_ &= forwardBitSet; // overlap of forward and backward is the real liveness
+  livenessMap.intersect(forwardLivenessMap); // overlap of forward and backward is the real liveness
 }
 
 struct InfoPrinter : public IInfoPrinter {
@@ -358,7 +301,7 @@ void dumpInfo(wasm::Module *m, wasm::Function *func, LocalsUses const &localsUse
 
 void ObjLivenessAnalyzer::runOnFunction(wasm::Module *m, wasm::Function *func) {
   SSAMap const &ssaMap = moduleLevelSSAMap_.at(func);
-  wasm::analysis::CFG cfg = wasm::analysis::CFG::fromFunction(func);
+  CFG const cfg = CFG::fromFunction(func);
 
   LocalsUses const localsUses = LocalsUses::create(func, ssaMap, cfg);
   TmpUses const tmpUses = TmpUses::create(func, ssaMap);
@@ -366,7 +309,7 @@ void ObjLivenessAnalyzer::runOnFunction(wasm::Module *m, wasm::Function *func) {
   LivenessMap &livenessMap = info_->at(func);
   livenessMap = LivenessMap{ssaMap};
 
-  for (wasm::analysis::BasicBlock const &bb : cfg) {
+  for (BasicBlock const &bb : cfg) {
     for (wasm::Expression *expr : bb) {
       if (expr->is<wasm::Call>() || expr->is<wasm::CallIndirect>() || expr->is<wasm::LocalGet>() ||
           expr->is<wasm::LocalSet>() || tmpUses.contains(expr)) {
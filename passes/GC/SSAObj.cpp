@@ -6,13 +6,16 @@
 
 namespace warpo::passes::gc {
 
-SSAMap SSAMap::create(wasm::Function *func) {
+SSAMap SSAMap::create(wasm::Function *func, ManagedParams const *managedParams) {
   struct Collector : public wasm::PostWalker<Collector> {
     SSAMap &ssaMap_;
-    explicit Collector(SSAMap &ssaMap) : ssaMap_(ssaMap) {}
+    ManagedParams const *managedParams_;
+    Collector(SSAMap &ssaMap, ManagedParams const *managedParams) : ssaMap_(ssaMap), managedParams_(managedParams) {}
     void doWalkFunction(wasm::Function *func) {
       for (size_t const localIndex : Range{func->getNumParams()}) {
-        if (func->getParams()[localIndex] == wasm::Type::i32) {
+        if (func->getParams()[localIndex] != wasm::Type::i32)
+          continue;
+        if (managedParams_ == nullptr || managedParams_->mayBeManaged(func->name, localIndex)) {
           ssaMap_.insert(SSAValue{static_cast<wasm::Index>(localIndex)});
         }
       }
@@ -35,7 +38,7 @@ SSAMap SSAMap::create(wasm::Function *func) {
   };
   SSAMap ssaMap{};
   if (func->body != nullptr) {
-    Collector collector{ssaMap};
+    Collector collector{ssaMap, managedParams};
     collector.walkFunction(func);
   }
   return ssaMap;
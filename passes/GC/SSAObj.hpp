@@ -2,6 +2,7 @@
 
 #include <map>
 
+#include "ManagedParams.hpp"
 #include "support/IncMap.hpp"
 #include "wasm.h"
 
@@ -60,7 +61,8 @@ struct SSAValue {
 };
 
 struct SSAMap : public IncBiMap<SSAValue> {
-  static SSAMap create(wasm::Function *func);
+  /// @brief params which are known to hold no managed reference in managedParams are excluded.
+  static SSAMap create(wasm::Function *func, ManagedParams const *managedParams = nullptr);
   std::optional<size_t> tryGetIndexFromExpr(wasm::Expression *expr) const {
     if (auto set = expr->dynCast<wasm::LocalSet>()) {
       if (!this->contains(SSAValue{set}))
@@ -76,10 +78,10 @@ struct SSAMap : public IncBiMap<SSAValue> {
 };
 
 struct ModuleLevelSSAMap : public std::map<wasm::Function *, SSAMap> {
-  static ModuleLevelSSAMap create(wasm::Module *m) {
+  static ModuleLevelSSAMap create(wasm::Module *m, ManagedParams const *managedParams = nullptr) {
     ModuleLevelSSAMap ssaMapModule{};
     for (auto &func : m->functions) {
-      ssaMapModule[func.get()] = SSAMap::create(func.get());
+      ssaMapModule[func.get()] = SSAMap::create(func.get(), managedParams);
     }
     return ssaMapModule;
   }
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "../helper/CFG.hpp"
+#include "../helper/DomTree.hpp"
+#include "Liveness.hpp"
+#include "ShrinkWrap.hpp"
+#include "StackAssigner.hpp"
+#include "ir/branch-utils.h"
+#include "ir/parents.h"
+#include "support/DynBitSet.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+namespace {
+
+/// @brief exprs from function body to expr
+std::vector<wasm::Expression *> getPath(wasm::Parents const &parents, wasm::Expression *expr) {
+  std::vector<wasm::Expression *> path{};
+  for (wasm::Expression *curr = expr; curr != nullptr; curr = parents.getParent(curr))
+    path.push_back(curr);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+size_t getItemIndex(wasm::Block *block, wasm::Expression *item) {
+  return static_cast<size_t>(std::find(block->list.begin(), block->list.end(), item) - block->list.begin());
+}
+
+/// @brief the block item which contains expr.
+std::optional<ShrinkWrapRegion> getEnclosingItem(wasm::Parents const &parents, wasm::Expression *expr) {
+  wasm::Expression *child = expr;
+  for (wasm::Expression *curr = parents.getParent(expr); curr != nullptr; curr = parents.getParent(curr)) {
+    if (auto *block = curr->dynCast<wasm::Block>()) {
+      size_t const index = getItemIndex(block, child);
+      return ShrinkWrapRegion{.block = block, .begin = index, .end = index + 1U};
+    }
+    child = curr;
+  }
+  return std::nullopt;
+}
+
+bool hasExitingBranch(ShrinkWrapRegion const &region) {
+  for (size_t i = region.begin; i < region.end; i++) {
+    if (!wasm::BranchUtils::getExitingBranches(region.block->list[i]).empty())
+      return true;
+  }
+  return false;
+}
+
+/// @brief whether every returning path from function entry executes a tostack call.
+bool isStoredOnEveryPath(wasm::Function *func, std::vector<wasm::Call *> const &toStackCalls) {
+  auto const cfg = std::make_shared<CFG>(CFG::fromFunction(func));
+  if (std::none_of(cfg->begin(), cfg->end(), [](BasicBlock const &bb) { return bb.isExit(); }))
+    return true;
+  DomTree const domTree = DomTree::create(cfg);
+  std::set<wasm::Expression *> const calls{toStackCalls.begin(), toStackCalls.end()};
+  BasicBlock const *const entry = &(*cfg)[0];
+  for (BasicBlock const &bb : *cfg) {
+    if (!domTree.isPostDom(&bb, entry))
+      continue;
+    if (std::any_of(bb.begin(), bb.end(), [&calls](wasm::Expression *expr) { return calls.contains(expr); }))
+      return true;
+  }
+  return false;
+}
+
+} // namespace
+
+DynBitset getRootedSSAValues(StackPosition const &stackPosition, LivenessMap const &livenessMap) {
+  DynBitset rooted{livenessMap.getDimension()};
+  for (auto const &[expr, base] : livenessMap.getExprMap()) {
+    wasm::Call *call = expr->dynCast<wasm::Call>();
+    if (auto *set = expr->dynCast<wasm::LocalSet>())
+      call = set->value->dynCast<wasm::Call>();
+    if (call == nullptr || !stackPosition.contains(call))
+      continue;
+    Liveness const liveness = livenessMap.getLiveness(base);
+    rooted |= liveness.after() & ~liveness.before();
+  }
+  return rooted;
+}
+
+std::optional<ShrinkWrapRegion> findShrinkWrapRegion(wasm::Function *func,
+                                                     std::vector<wasm::Call *> const &toStackCalls,
+                                                     LivenessMap const &livenessMap, DynBitset const &rooted) {
+  if (toStackCalls.empty() || isStoredOnEveryPath(func, toStackCalls))
+    return std::nullopt;
+
+  wasm::Parents const parents{func->body};
+  std::vector<wasm::Expression *> required{toStackCalls.begin(), toStackCalls.end()};
+  for (auto const &[expr, base] : livenessMap.getExprMap()) {
+    // tostack calls without stack position have been removed from function body
+    if (expr != func->body && parents.getParent(expr) == nullptr)
+      continue;
+    Liveness const liveness = livenessMap.getLiveness(base);
+    if ((liveness.before() & rooted).any() || (liveness.after() & rooted).any())
+      required.push_back(expr);
+  }
+
+  std::vector<std::vector<wasm::Expression *>> paths{};
+  paths.reserve(required.size());
+  for (wasm::Expression *expr : required)
+    paths.push_back(getPath(parents, expr));
+  // lowest common ancestor of all required exprs
+  std::vector<wasm::Expression *> lca = paths.front();
+  for (std::vector<wasm::Expression *> const &path : paths) {
+    auto const [lcaIt, _] = std::mismatch(lca.begin(), lca.end(), path.begin(), path.end());
+    lca.erase(lcaIt, lca.end());
+  }
+  // setting up the frame inside of a loop would repeat it per iteration, the region must contain the outermost loop.
+  auto const loopIt =
+      std::find_if(lca.begin(), lca.end(), [](wasm::Expression *expr) { return expr->is<wasm::Loop>(); });
+  if (loopIt != lca.end())
+    lca.erase(loopIt + 1, lca.end());
+
+  std::optional<ShrinkWrapRegion> region{};
+  auto *const lcaBlock = lca.back()->dynCast<wasm::Block>();
+  // lca itself is required when it is not a parent of all required exprs
+  bool const isItemsOfLCA = lcaBlock != nullptr && std::all_of(paths.begin(), paths.end(), [&lca](auto const &path) {
+                              return path.size() > lca.size();
+                            });
+  if (isItemsOfLCA) {
+    region = ShrinkWrapRegion{.block = lcaBlock, .begin = lcaBlock->list.size(), .end = 0U};
+    for (std::vector<wasm::Expression *> const &path : paths) {
+      size_t const index = getItemIndex(lcaBlock, path[lca.size()]);
+      region->begin = std::min(region->begin, index);
+      region->end = std::max(region->end, index + 1U);
+    }
+  } else {
+    region = getEnclosingItem(parents, lca.back());
+  }
+
+  while (region.has_value()) {
+    if (region->block == func->body && region->begin == 0U && region->end == region->block->list.size())
+      return std::nullopt;
+    if (!hasExitingBranch(region.value()))
+      return region;
+    region = getEnclosingItem(parents, region->block);
+  }
+  return std::nullopt;
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../helper/ToString.hpp"
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+std::unique_ptr<wasm::Module> lowerWithShrinkWrap(std::string_view funcWat) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.shrinkWrap = true;
+  return lowerGCTestWat(funcWat, config);
+}
+
+} // namespace
+
+TEST(ShrinkWrapTest, FastPathSkipsFrame) {
+  std::unique_ptr<wasm::Module> m = lowerWithShrinkWrap(R"(
+    (func $f (param i32) (result i32)
+      (local i32)
+      (if (local.get 0)
+        (then (return (i32.const 0)))
+      )
+      (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (drop (call $~lib/rt/itcms/__new))
+      (local.get 1)
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  auto *body = f->body->dynCast<wasm::Block>();
+  ASSERT_NE(body, nullptr);
+  ASSERT_EQ(body->list.size(), 2U);
+  EXPECT_TRUE(body->list[0]->is<wasm::If>());
+  auto *wrapper = body->list[1]->dynCast<wasm::Block>();
+  ASSERT_NE(wrapper, nullptr);
+  auto *prologue = wrapper->list.front()->dynCast<wasm::Call>();
+  ASSERT_NE(prologue, nullptr);
+  EXPECT_EQ(prologue->target, wasm::Name{"~lib/rt/__decrease_sp"});
+  EXPECT_EQ(wrapper->type, wasm::Type::i32);
+  std::string const str = toString(f);
+  EXPECT_NE(str.find("__tostack<0>"), std::string::npos);
+  EXPECT_EQ(str.find("__decrease_sp"), str.rfind("__decrease_sp"));
+}
+
+TEST(ShrinkWrapTest, WrapWholeBodyWhenEveryPathStores) {
+  std::unique_ptr<wasm::Module> m = lowerWithShrinkWrap(R"(
+    (func $f (result i32)
+      (local i32)
+      (drop (call $~lib/rt/itcms/__new))
+      (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (drop (call $~lib/rt/itcms/__new))
+      (local.get 0)
+    )
+  )");
+  auto *body = m->getFunction("f")->body->dynCast<wasm::Block>();
+  ASSERT_NE(body, nullptr);
+  auto *prologue = body->list.front()->dynCast<wasm::Call>();
+  ASSERT_NE(prologue, nullptr);
+  EXPECT_EQ(prologue->target, wasm::Name{"~lib/rt/__decrease_sp"});
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "Liveness.hpp"
+#include "StackAssigner.hpp"
+#include "support/DynBitSet.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief consecutive items [begin, end) of block which need the shadow stack frame.
+struct ShrinkWrapRegion {
+  wasm::Block *block;
+  size_t begin;
+  size_t end;
+};
+
+/// @brief SSA values which are stored to shadow stack, i.e. created by a tostack call with stack position.
+DynBitset getRootedSSAValues(StackPosition const &stackPosition, LivenessMap const &livenessMap);
+
+/// @brief find the smallest block item range which contains all tostack calls and every expr where a rooted SSA value
+/// is live.
+/// @details the region never starts inside a loop and no branch leaves it, so the frame is set up and torn down
+/// exactly once on each path through it. nullopt means the whole function body should be wrapped, either because no
+/// smaller region exists or because every returning path from function entry stores to shadow stack anyway.
+std::optional<ShrinkWrapRegion> findShrinkWrapRegion(wasm::Function *func,
+                                                     std::vector<wasm::Call *> const &toStackCalls,
+                                                     LivenessMap const &livenessMap, DynBitset const &rooted);
+
+} // namespace warpo::passes::gc
@@ -0,0 +1,130 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "../helper/CFG.hpp"
+#include "../helper/GenKillDataflow.hpp"
+#include "CollectLeafFunction.hpp"
+#include "GCInfo.hpp"
+#include "SlotAssignment.hpp"
+#include "StackAssigner.hpp"
+#include "support/DynBitSet.hpp"
+#include "support/Range.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+namespace {
+
+/// @brief bit i means slot i is possibly unassigned.
+struct UnassignedSlotTransferFn : public IGenKillTransfer {
+  StackPosition const &stackPosition_;
+  LeafFunc const *leaf_;
+  size_t slotCount_;
+  bool isCollectedWithUnassignedSlot_ = false;
+
+  UnassignedSlotTransferFn(StackPosition const &stackPosition, LeafFunc const *leaf, size_t slotCount)
+      : stackPosition_(stackPosition), leaf_(leaf), slotCount_(slotCount) {}
+
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    auto *call = expr->dynCast<wasm::Call>();
+    if (call == nullptr)
+      return;
+    if (call->target == FnDecreaseSP || call->target == FnIncreaseSP) {
+      // frame is set up with stale values, or it is released
+      for (size_t const slot : Range{slotCount_}) {
+        if (call->target == FnDecreaseSP)
+          effect.gen(slot);
+        else
+          effect.kill(slot);
+      }
+      return;
+    }
+    auto const it = stackPosition_.find(call);
+    if (it != stackPosition_.end())
+      effect.kill(it->second / StackSlotStatistics::SlotSize);
+  }
+
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    if (isCollectedWithUnassignedSlot_ || !mayCollect(expr))
+      return;
+    isCollectedWithUnassignedSlot_ = state.any();
+  }
+
+private:
+  bool mayCollect(wasm::Expression *expr) const {
+    if (expr->is<wasm::CallIndirect>() || expr->is<wasm::CallRef>())
+      return true;
+    auto *call = expr->dynCast<wasm::Call>();
+    if (call == nullptr || call->target == FnDecreaseSP || call->target == FnIncreaseSP ||
+        stackPosition_.contains(call))
+      return false;
+    return leaf_ == nullptr || !leaf_->contains(call->target);
+  }
+};
+
+} // namespace
+
+bool isFrameAssignedBeforeCollection(wasm::Function *func, StackPosition const &stackPosition, uint32_t frameSize,
+                                     LeafFunc const *leaf) {
+  size_t const slotCount = frameSize / StackSlotStatistics::SlotSize;
+  CFG const cfg = CFG::fromFunction(func);
+  UnassignedSlotTransferFn transfer{stackPosition, leaf, slotCount};
+  GenKillDataflow dataflow{cfg, slotCount, DataflowDirection::Forward, transfer};
+  dataflow.solve();
+  dataflow.collectResults();
+  return !transfer.isCollectedWithUnassignedSlot_;
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+#include "../helper/ToString.hpp"
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+std::string lowerWithFrameFillElision(std::string_view funcWat) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.elideFrameFill = true;
+  return toString(lowerGCTestWat(funcWat, config)->getFunction("f"));
+}
+
+} // namespace
+
+TEST(SlotAssignmentTest, StoredBeforeCollection) {
+  std::string const lowered = lowerWithFrameFillElision(R"(
+    (func $f
+      (call $use
+        (call $~lib/rt/__tmptostack (i32.load (i32.const 0)))
+        (call $~lib/rt/itcms/__new)
+      )
+    )
+  )");
+  EXPECT_NE(lowered.find("__tostack<0>"), std::string::npos);
+  EXPECT_NE(lowered.find(gc::FnDecreaseSPWithoutFill), std::string::npos);
+}
+
+TEST(SlotAssignmentTest, CollectionBeforeStore) {
+  std::string const lowered = lowerWithFrameFillElision(R"(
+    (func $f
+      (local i32)
+      (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (call $use (call $~lib/rt/itcms/__new) (local.get 0))
+    )
+  )");
+  EXPECT_NE(lowered.find("__tostack<0>"), std::string::npos);
+  EXPECT_EQ(lowered.find(gc::FnDecreaseSPWithoutFill), std::string::npos);
+  EXPECT_NE(lowered.find(gc::FnDecreaseSP), std::string::npos);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#include "CollectLeafFunction.hpp"
+#include "StackAssigner.hpp"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief definite assignment analysis of shadow stack slots on lowered function.
+/// @details a slot is unassigned from `__decrease_sp` until a tostack call stores to it. When no slot can be unassigned
+/// at any possible collection point, GC never scans stale values in the frame and zero filling it is not needed.
+/// @param leaf GC leaf functions, nullptr means every call may collect
+bool isFrameAssignedBeforeCollection(wasm::Function *func, StackPosition const &stackPosition, uint32_t frameSize,
+                                     LeafFunc const *leaf);
+
+} // namespace warpo::passes::gc
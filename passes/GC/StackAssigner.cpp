@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
@@ -57,7 +58,7 @@ struct Process : public wasm::PostWalker<Process, wasm::UnifiedExpressionVisitor
     if (auto set = expr->dynCast<wasm::LocalSet>()) {
       // localtostack
       if (!matcher::isCall(matcher::call::callee(FnLocalToStack))(*set->value)) {
-        // some parameter will be treat as GC object by mistake.
+        // some parameter will be treat as GC object by mistake when its type is unknown, see ManagedParams.
         return failed();
       }
       return succeed(set->value->cast<wasm::Call>());
@@ -101,10 +102,28 @@ static void calStackPositionWithVanillaAlgorithm(wasm::Function *func, StackPosi
   process.walkFunction(func);
 }
 
-static void calStackPositionWithGreedyConflictGraphAlgorithm(wasm::Function *func, StackPosition &stackPosition,
-                                                             LivenessMap const &livenessMap) {
+static size_t getSlotCount(ColorVec const &color, LivenessMap const &livenessMap) {
+  size_t slotCount = 0;
+  for (size_t const ssaIndex : Range{livenessMap.getDimension()}) {
+    if (!livenessMap.isInvalid(ssaIndex) && !livenessMap.getLiveRanges(ssaIndex).empty())
+      slotCount = std::max(slotCount, color.getColor(ssaIndex) + 1);
+  }
+  return slotCount;
+}
+
+static void calStackPositionWithConflictGraphAlgorithm(wasm::Function *func, StackPosition &stackPosition,
+                                                       LivenessMap const &livenessMap, bool optimal,
+                                                       StackSlotStatistics *statistics) {
   ConflictGraph const conflictGraph = ConflictGraph::create(livenessMap);
-  ColorVec const color = conflictGraph.color();
+  ColorVec const color = optimal ? conflictGraph.colorOptimal() : conflictGraph.color();
+  if (statistics != nullptr) {
+    size_t const assignedSlots = getSlotCount(color, livenessMap);
+    size_t const greedySlots = optimal ? getSlotCount(conflictGraph.color(), livenessMap) : assignedSlots;
+    statistics->greedySlots += greedySlots;
+    statistics->assignedSlots += assignedSlots;
+    if (assignedSlots < greedySlots)
+      statistics->improvedFunctions++;
+  }
   if (support::isDebug(PASS_NAME, func->name.str)) {
     fmt::println("=========ConflictGraph=========");
     fmt::println("{}", func->name.str);
@@ -126,7 +145,10 @@ void StackAssigner::runOnFunction(wasm::Module *m, wasm::Function *func) {
     calStackPositionWithVanillaAlgorithm(func, stackPosition, livenessMap);
     break;
   case Mode::GreedyConflictGraph:
-    calStackPositionWithGreedyConflictGraphAlgorithm(func, stackPosition, livenessMap);
+    calStackPositionWithConflictGraphAlgorithm(func, stackPosition, livenessMap, false, statistics_.get());
+    break;
+  case Mode::OptimalConflictGraph:
+    calStackPositionWithConflictGraphAlgorithm(func, stackPosition, livenessMap, true, statistics_.get());
     break;
   }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <memory>
 
@@ -19,8 +20,16 @@ struct StackPosition : private std::map<wasm::Call *, uint32_t> {
 };
 using StackPositions = std::map<wasm::Function *, StackPosition>;
 
+/// @brief shadow stack slots of all assigned functions, by greedy coloring and by the selected coloring.
+struct StackSlotStatistics {
+  std::atomic<size_t> greedySlots{0};
+  std::atomic<size_t> assignedSlots{0};
+  std::atomic<size_t> improvedFunctions{0};
+  static constexpr size_t SlotSize = 4U;
+};
+
 struct StackAssigner : public wasm::Pass {
-  enum class Mode { Vanilla, GreedyConflictGraph };
+  enum class Mode { Vanilla, GreedyConflictGraph, OptimalConflictGraph };
   static StackPositions createResults(wasm::Module *m) {
     StackPositions ret{};
     for (std::unique_ptr<wasm::Function> const &f : m->functions) {
@@ -31,23 +40,27 @@ struct StackAssigner : public wasm::Pass {
   Mode mode_;
   std::shared_ptr<StackPositions> stackPositions_;
   std::shared_ptr<ObjLivenessInfo const> livenessInfo_;
+  /// @brief nullptr means statistics are not collected
+  std::shared_ptr<StackSlotStatistics> statistics_;
   explicit StackAssigner(Mode mode, std::shared_ptr<StackPositions> const &stackPositions,
-                         std::shared_ptr<ObjLivenessInfo const> const &livenessInfo)
-      : mode_(mode), stackPositions_(stackPositions), livenessInfo_(livenessInfo) {
+                         std::shared_ptr<ObjLivenessInfo const> const &livenessInfo,
+                         std::shared_ptr<StackSlotStatistics> const &statistics = nullptr)
+      : mode_(mode), stackPositions_(stackPositions), livenessInfo_(livenessInfo), statistics_(statistics) {
     name = "StackAssigner";
   }
   bool isFunctionParallel() override { return true; }
   std::unique_ptr<Pass> create() override {
-    return std::make_unique<StackAssigner>(mode_, stackPositions_, livenessInfo_);
+    return std::make_unique<StackAssigner>(mode_, stackPositions_, livenessInfo_, statistics_);
   }
   bool modifiesBinaryenIR() override { return false; }
 
   void runOnFunction(wasm::Module *m, wasm::Function *func) override;
 
-  static std::shared_ptr<StackPositions> addToPass(wasm::PassRunner &runner, Mode mode,
-                                                   std::shared_ptr<ObjLivenessInfo const> const &livenessInfo) {
+  static std::shared_ptr<StackPositions>
+  addToPass(wasm::PassRunner &runner, Mode mode, std::shared_ptr<ObjLivenessInfo const> const &livenessInfo,
+            std::shared_ptr<StackSlotStatistics> const &statistics = nullptr) {
     auto stackPositions = std::make_shared<StackPositions>(StackAssigner::createResults(runner.wasm));
-    runner.add(std::unique_ptr<wasm::Pass>(new gc::StackAssigner(mode, stackPositions, livenessInfo)));
+    runner.add(std::unique_ptr<wasm::Pass>(new gc::StackAssigner(mode, stackPositions, livenessInfo, statistics)));
     return stackPositions;
   }
 };
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "../helper/BuildCallGraph.hpp"
+#include "GCInfo.hpp"
+#include "StackAssigner.hpp"
+#include "StackDepth.hpp"
+#include "fmt/base.h"
+#include "literal.h"
+#include "support/Debug.hpp"
+#include "support/name.h"
+#include "wasm-builder.h"
+#include "wasm-traversal.h"
+#include "wasm.h"
+
+#define PASS_NAME "StackDepth"
+#define DEBUG_PREFIX "[StackDepth] "
+
+namespace warpo::passes::gc {
+
+namespace {
+
+uint32_t getFrameSize(StackPosition const &stackPosition) {
+  uint32_t frameSize = 0U;
+  for (auto const &[_, offset] : stackPosition)
+    frameSize = std::max(frameSize, offset + static_cast<uint32_t>(StackSlotStatistics::SlotSize));
+  return frameSize;
+}
+
+std::set<wasm::Name> getEntries(wasm::Module const &m) {
+  std::set<wasm::Name> entries{};
+  bool isTableExported = false;
+  for (std::unique_ptr<wasm::Export> const &e : m.exports) {
+    if (e->kind == wasm::ExternalKind::Function)
+      entries.insert(e->value);
+    if (e->kind == wasm::ExternalKind::Table)
+      isTableExported = true;
+  }
+  if (m.start.is())
+    entries.insert(m.start);
+  if (isTableExported) {
+    // functions in exported table can be called from host directly
+    for (std::unique_ptr<wasm::ElementSegment> const &segment : m.elementSegments) {
+      for (wasm::Expression *item : segment->data) {
+        if (auto *refFunc = item->dynCast<wasm::RefFunc>())
+          entries.insert(refFunc->func);
+      }
+    }
+  }
+  return entries;
+}
+
+/// @brief depth of each function in call graph, nullopt means unbounded.
+/// @details a function is unbounded when its DFS subtree contains a back edge, i.e. it reaches a cycle.
+std::map<wasm::Name, std::optional<uint32_t>> computeDepths(CallGraph const &cg,
+                                                            std::map<wasm::Name, uint32_t> const &frameSizes) {
+  enum class State { Visiting, Visited };
+  std::map<wasm::Name, State> states{};
+  std::map<wasm::Name, std::optional<uint32_t>> depths{};
+  struct Frame {
+    wasm::Name func;
+    std::set<wasm::Name>::const_iterator next;
+    std::optional<uint64_t> depth;
+  };
+  for (auto const &[root, _] : cg) {
+    if (states.contains(root))
+      continue;
+    std::vector<Frame> stack{};
+    auto const enter = [&](wasm::Name const &func) {
+      states.insert_or_assign(func, State::Visiting);
+      auto const frameSizeIt = frameSizes.find(func);
+      stack.push_back(Frame{.func = func,
+                            .next = cg.at(func).begin(),
+                            .depth = frameSizeIt == frameSizes.end() ? 0U : frameSizeIt->second});
+    };
+    enter(root);
+    while (!stack.empty()) {
+      Frame &frame = stack.back();
+      std::set<wasm::Name> const &callees = cg.at(frame.func);
+      if (frame.next == callees.end()) {
+        std::optional<uint64_t> const depth = frame.depth;
+        wasm::Name const func = frame.func;
+        bool const isBounded = depth.has_value() && depth.value() <= std::numeric_limits<int32_t>::max();
+        depths.insert_or_assign(func, isBounded ? std::optional<uint32_t>{static_cast<uint32_t>(depth.value())}
+                                                : std::nullopt);
+        states.insert_or_assign(func, State::Visited);
+        stack.pop_back();
+        continue;
+      }
+      wasm::Name const callee = *frame.next;
+      auto const stateIt = states.find(callee);
+      if (stateIt == states.end()) {
+        // callee is visited again after it is finished
+        enter(callee);
+        continue;
+      }
+      ++frame.next;
+      std::optional<uint32_t> const calleeDepth =
+          stateIt->second == State::Visiting ? std::nullopt : depths.at(callee);
+      if (frame.depth.has_value() && calleeDepth.has_value()) {
+        auto const frameSizeIt = frameSizes.find(frame.func);
+        uint64_t const frameSize = frameSizeIt == frameSizes.end() ? 0U : frameSizeIt->second;
+        frame.depth = std::max(frame.depth.value(), frameSize + calleeDepth.value());
+      } else {
+        frame.depth = std::nullopt;
+      }
+    }
+  }
+  return depths;
+}
+
+} // namespace
+
+void StackDepthAnalyzer::run(wasm::Module *m) {
+  std::map<wasm::Name, uint32_t> frameSizes{};
+  for (auto const &[func, stackPosition] : *stackPositions_)
+    frameSizes.insert_or_assign(func->name, getFrameSize(stackPosition));
+  std::map<wasm::Name, std::optional<uint32_t>> const depths = computeDepths(*cg_, frameSizes);
+
+  std::map<wasm::Name, std::vector<wasm::Name>> callers{};
+  for (auto const &[caller, callees] : *cg_) {
+    for (wasm::Name const &callee : callees)
+      callers[callee].push_back(caller);
+  }
+  std::set<wasm::Name> const entries = getEntries(*m);
+
+  for (std::unique_ptr<wasm::Function> const &f : m->functions) {
+    StackDepth depth{};
+    auto const frameSizeIt = frameSizes.find(f->name);
+    depth.frameSize = frameSizeIt == frameSizes.end() ? 0U : frameSizeIt->second;
+    auto const depthIt = depths.find(f->name);
+    depth.depth = depthIt == depths.end() ? std::nullopt : depthIt->second;
+    depth.isEntry = entries.contains(f->name);
+    auto const callersIt = callers.find(f->name);
+    depth.isCovered = depth.depth.has_value() && !depth.isEntry && callersIt != callers.end() &&
+                      std::all_of(callersIt->second.begin(), callersIt->second.end(),
+                                  [&depths](wasm::Name const &caller) { return depths.at(caller).has_value(); });
+    if (support::isDebug(PASS_NAME, f->name.str))
+      fmt::println(DEBUG_PREFIX "'{}': frame {}, depth {}, entry {}, covered {}", f->name.str, depth.frameSize,
+                   depth.depth.has_value() ? fmt::format("{}", depth.depth.value()) : "unbounded", depth.isEntry,
+                   depth.isCovered);
+    result_->insert_or_assign(f.get(), depth);
+  }
+}
+
+std::optional<uint32_t> StackDepthAnalyzer::getWorstCaseDepth(StackDepths const &depths) {
+  uint32_t worstCaseDepth = 0U;
+  for (auto const &[_, depth] : depths) {
+    if (!depth.isEntry)
+      continue;
+    if (!depth.depth.has_value())
+      return std::nullopt;
+    worstCaseDepth = std::max(worstCaseDepth, depth.depth.value());
+  }
+  return worstCaseDepth;
+}
+
+void StackCheckLowering::runOnFunction(wasm::Module *m, wasm::Function *func) {
+  StackDepth const &depth = depths_->at(func);
+  // recursive functions check each frame
+  if (!depth.depth.has_value())
+    return;
+  bool const isCheckedAtEntry = !depth.isCovered && depth.depth.value() > depth.frameSize;
+  if (depth.isCovered || isCheckedAtEntry) {
+    struct DecreaseSPReplacer : public wasm::PostWalker<DecreaseSPReplacer> {
+      void visitCall(wasm::Call *expr) {
+        if (expr->target == FnDecreaseSP)
+          expr->target = FnDecreaseSPWithoutCheck;
+        else if (expr->target == FnDecreaseSPWithoutFill)
+          expr->target = FnDecreaseSPWithoutFillAndCheck;
+      }
+    };
+    DecreaseSPReplacer replacer{};
+    replacer.walk(func->body);
+  }
+  if (isCheckedAtEntry) {
+    wasm::Builder b{*m};
+    func->body = b.makeSequence(
+        b.makeCall(FnCheckStack, {b.makeConst(wasm::Literal(depth.depth.value()))}, wasm::Type::none), func->body);
+  }
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../helper/ToString.hpp"
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+constexpr std::string_view stackDepthTestWat = R"(
+  (export "main" (func $main))
+  (export "recursive" (func $recursive))
+  (func $main
+    (call $a)
+  )
+  (func $a
+    (local i32)
+    (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+    (call $b)
+    (call $use (i32.const 0) (local.get 0))
+  )
+  (func $b
+    (local i32)
+    (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+    (call $use (call $~lib/rt/itcms/__new) (local.get 0))
+  )
+  (func $recursive
+    (local i32)
+    (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+    (call $recursive)
+    (call $use (i32.const 0) (local.get 0))
+  )
+)";
+
+} // namespace
+
+TEST(StackDepthTest, CheckOncePerCallTree) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.interproceduralStackCheck = true;
+  std::unique_ptr<wasm::Module> m = lowerGCTestWat(stackDepthTestWat, config);
+
+  std::string const main = toString(m->getFunction("main"));
+  EXPECT_NE(main.find(gc::FnCheckStack), std::string::npos);
+  EXPECT_NE(main.find("i32.const 8"), std::string::npos);
+  EXPECT_NE(toString(m->getFunction("a")).find(gc::FnDecreaseSPWithoutCheck), std::string::npos);
+  EXPECT_NE(toString(m->getFunction("b")).find(gc::FnDecreaseSPWithoutCheck), std::string::npos);
+
+  std::string const recursive = toString(m->getFunction("recursive"));
+  EXPECT_EQ(recursive.find(gc::FnDecreaseSPWithoutCheck), std::string::npos);
+  EXPECT_EQ(recursive.find(gc::FnCheckStack), std::string::npos);
+  EXPECT_NE(recursive.find(gc::FnDecreaseSP), std::string::npos);
+}
+
+TEST(StackDepthTest, CheckFunctionInImportedTable) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.interproceduralStackCheck = true;
+  std::unique_ptr<wasm::Module> m = lowerGCTestWat(R"(
+    (type $v_v (func))
+    (table $table (import "env" "table") 1 funcref)
+    (elem (table $table) (i32.const 0) func $x)
+    (export "y" (func $y))
+    (export "z" (func $z))
+    (func $x
+      (local i32)
+      (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (call $use (call $~lib/rt/itcms/__new) (local.get 0))
+    )
+    (func $y
+      (local i32)
+      (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (call_indirect $table (type $v_v) (i32.const 0))
+      (call $use (i32.const 0) (local.get 0))
+    )
+    (func $z
+      (call $x)
+    )
+  )",
+                                                   config);
+  // host can call any function through the imported table, so callers in call graph do not cover $x
+  std::string const x = toString(m->getFunction("x"));
+  EXPECT_EQ(x.find(gc::FnDecreaseSPWithoutCheck), std::string::npos);
+  EXPECT_NE(x.find(gc::FnDecreaseSP), std::string::npos);
+  std::string const y = toString(m->getFunction("y"));
+  EXPECT_EQ(y.find(gc::FnDecreaseSPWithoutCheck), std::string::npos);
+}
+
+TEST(StackDepthTest, WorstCaseDepth) {
+  gc::StackDepths depths{};
+  std::unique_ptr<wasm::Module> m = loadGCTestWat(stackDepthTestWat);
+  depths[m->getFunction("main")] = gc::StackDepth{.frameSize = 0U, .depth = 8U, .isEntry = true, .isCovered = false};
+  depths[m->getFunction("a")] = gc::StackDepth{.frameSize = 4U, .depth = 8U, .isEntry = false, .isCovered = true};
+  EXPECT_EQ(gc::StackDepthAnalyzer::getWorstCaseDepth(depths), 8U);
+  depths[m->getFunction("recursive")] =
+      gc::StackDepth{.frameSize = 4U, .depth = std::nullopt, .isEntry = true, .isCovered = false};
+  EXPECT_EQ(gc::StackDepthAnalyzer::getWorstCaseDepth(depths), std::nullopt);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
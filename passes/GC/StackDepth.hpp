@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+
+#include "../helper/BuildCallGraph.hpp"
+#include "StackAssigner.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief shadow stack usage of a function.
+struct StackDepth {
+  uint32_t frameSize = 0U;
+  /// @brief worst case shadow stack size used by the function and its callees, nullopt means unbounded because the
+  /// function is recursive or calls a recursive function.
+  std::optional<uint32_t> depth = std::nullopt;
+  /// @brief function can be called from outside of the module
+  bool isEntry = false;
+  /// @brief every caller has a bounded depth, so the overflow check of the caller already covers this function.
+  bool isCovered = false;
+};
+using StackDepths = std::map<wasm::Function *, StackDepth>;
+
+/// @brief compute shadow stack depth of functions from call graph and frame sizes.
+/// @details functions in a non-recursive call tree do not check shadow stack overflow. The check happens once at
+/// entry points and at boundaries of recursive call graph SCC, with the depth of the whole subtree.
+struct StackDepthAnalyzer : public wasm::Pass {
+  std::shared_ptr<CallGraph const> cg_;
+  std::shared_ptr<StackPositions const> stackPositions_;
+  std::shared_ptr<StackDepths> result_;
+  StackDepthAnalyzer(std::shared_ptr<CallGraph const> const &cg,
+                     std::shared_ptr<StackPositions const> const &stackPositions,
+                     std::shared_ptr<StackDepths> const &result)
+      : cg_(cg), stackPositions_(stackPositions), result_(result) {
+    name = "StackDepthAnalyzer";
+  }
+  bool modifiesBinaryenIR() override { return false; }
+  void run(wasm::Module *m) override;
+
+  static std::shared_ptr<StackDepths> addToPass(wasm::PassRunner &runner, std::shared_ptr<CallGraph const> const &cg,
+                                                std::shared_ptr<StackPositions const> const &stackPositions) {
+    auto result = std::make_shared<StackDepths>();
+    runner.add(std::unique_ptr<wasm::Pass>(new StackDepthAnalyzer(cg, stackPositions, result)));
+    return result;
+  }
+
+  /// @brief worst case depth of all entry points, nullopt means unbounded.
+  static std::optional<uint32_t> getWorstCaseDepth(StackDepths const &depths);
+};
+
+/// @brief replace shadow stack overflow check of lowered functions according to StackDepths.
+/// @details covered functions set up their frame without check. Other functions with bounded depth check the depth of
+/// the whole subtree at function entry.
+struct StackCheckLowering : public wasm::Pass {
+  std::shared_ptr<StackDepths const> depths_;
+  explicit StackCheckLowering(std::shared_ptr<StackDepths const> const &depths) : depths_(depths) {
+    name = "StackCheckLowering";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override { return std::make_unique<StackCheckLowering>(depths_); }
+  bool modifiesBinaryenIR() override { return true; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override;
+};
+
+} // namespace warpo::passes::gc
@@ -0,0 +1,327 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "../helper/BuildCallGraph.hpp"
+#include "../helper/ToString.hpp"
+#include "GCInfo.hpp"
+#include "StackPositionCache.hpp"
+#include "pass.h"
+#include "wasm-traversal.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+namespace {
+
+constexpr std::string_view cacheVersion = "warpo-gc-stack-position-v2";
+
+uint64_t fnv1a(std::string_view str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char const c : str) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::filesystem::path getEntryPath(std::string const &dir, std::string const &key) {
+  return std::filesystem::path{dir} / fmt::format("{:016x}", fnv1a(key));
+}
+
+/// @brief tostack calls in walking order, the order is the same as long as the function body is the same.
+std::vector<wasm::Call *> collectToStackCalls(wasm::Function *func) {
+  struct Collector : public wasm::PostWalker<Collector> {
+    std::vector<wasm::Call *> calls_;
+    void visitCall(wasm::Call *expr) {
+      if (expr->target == FnLocalToStack || expr->target == FnTmpToStack)
+        calls_.push_back(expr);
+    }
+  };
+  Collector collector{};
+  collector.walk(func->body);
+  return std::move(collector.calls_);
+}
+
+std::string makeKey(std::string const &configKey, wasm::Module *m, wasm::Function *func, LeafFunc const *leaf,
+                    IndirectCallTargets const &indirectCallTargets, ManagedParams const *managedParams) {
+  struct CalleeCollector : public wasm::PostWalker<CalleeCollector> {
+    IndirectCallTargets const &indirectCallTargets_;
+    std::set<wasm::Name> callees_;
+    explicit CalleeCollector(IndirectCallTargets const &indirectCallTargets)
+        : indirectCallTargets_(indirectCallTargets) {}
+    void visitCall(wasm::Call *expr) { callees_.insert(expr->target); }
+    void visitCallIndirect(wasm::CallIndirect *expr) {
+      std::set<wasm::Name> const targets = indirectCallTargets_.get(*getModule(), expr);
+      callees_.insert(targets.begin(), targets.end());
+    }
+  };
+  std::string key = fmt::format("{}\n{}\n", cacheVersion, configKey);
+  if (leaf != nullptr) {
+    CalleeCollector collector{indirectCallTargets};
+    collector.setModule(m);
+    collector.walk(func->body);
+    for (wasm::Name const &callee : collector.callees_)
+      key += fmt::format("{} {}\n", leaf->contains(callee) ? "leaf" : "gc", callee.str);
+  }
+  if (managedParams != nullptr) {
+    std::set<wasm::Index> const *params = managedParams->get(func->name);
+    key += params == nullptr ? "managed-params unknown\n" : fmt::format("managed-params {}\n", fmt::join(*params, " "));
+  }
+  // binaryen printer keeps label names, so bodies which only differ in branch targets get different keys.
+  std::stringstream ss{};
+  ss << *func;
+  key += std::move(ss).str();
+  return key;
+}
+
+/// @brief entry format: `<key size>\n<key><offset or '-'> ...`
+std::optional<std::vector<std::optional<uint32_t>>> load(std::string const &dir, std::string const &key) {
+  std::ifstream is{getEntryPath(dir, key), std::ios::binary};
+  if (!is.good())
+    return std::nullopt;
+  size_t keySize = 0U;
+  if (!(is >> keySize) || is.get() != '\n' || keySize != key.size())
+    return std::nullopt;
+  std::string storedKey(keySize, '\0');
+  if (!is.read(storedKey.data(), static_cast<std::streamsize>(keySize)) || storedKey != key)
+    return std::nullopt;
+  std::vector<std::optional<uint32_t>> offsets{};
+  std::string offset{};
+  while (is >> offset) {
+    if (offset == "-") {
+      offsets.push_back(std::nullopt);
+      continue;
+    }
+    try {
+      offsets.push_back(static_cast<uint32_t>(std::stoul(offset)));
+    } catch (std::exception const &) {
+      return std::nullopt;
+    }
+  }
+  return offsets;
+}
+
+void store(std::string const &dir, std::string const &key, std::vector<std::optional<uint32_t>> const &offsets) {
+  std::stringstream ss{};
+  ss << key.size() << "\n" << key;
+  for (std::optional<uint32_t> const &offset : offsets) {
+    if (offset.has_value())
+      ss << offset.value() << " ";
+    else
+      ss << "- ";
+  }
+  std::filesystem::path const path = getEntryPath(dir, key);
+  // write to a unique temporary file and rename, so concurrent builds never see a partial entry.
+  std::filesystem::path tmpPath = path;
+  tmpPath += fmt::format(".{}.{}.tmp", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream os{tmpPath, std::ios::binary | std::ios::out};
+    os << std::move(ss).str();
+    if (!os.good())
+      return;
+  }
+  std::error_code ec{};
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+struct StackPositionCacheLoader : public wasm::Pass {
+  std::string dir_;
+  std::string configKey_;
+  std::shared_ptr<LeafFunc const> leaf_;
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets_;
+  std::shared_ptr<ManagedParams const> managedParams_;
+  std::shared_ptr<StackPositionCacheEntries> entries_;
+  StackPositionCacheLoader(std::string dir, std::string configKey, std::shared_ptr<LeafFunc const> leaf,
+                           std::shared_ptr<IndirectCallTargets const> indirectCallTargets,
+                           std::shared_ptr<ManagedParams const> managedParams,
+                           std::shared_ptr<StackPositionCacheEntries> entries)
+      : dir_(std::move(dir)), configKey_(std::move(configKey)), leaf_(std::move(leaf)),
+        indirectCallTargets_(std::move(indirectCallTargets)), managedParams_(std::move(managedParams)),
+        entries_(std::move(entries)) {
+    name = "StackPositionCacheLoader";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<StackPositionCacheLoader>(dir_, configKey_, leaf_, indirectCallTargets_, managedParams_,
+                                                      entries_);
+  }
+  bool modifiesBinaryenIR() override { return false; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override {
+    StackPositionCacheEntry &entry = entries_->at(func);
+    entry.key = makeKey(configKey_, m, func, leaf_.get(), *indirectCallTargets_, managedParams_.get());
+    entry.cached = load(dir_, entry.key);
+    // corrupted or stale entry is treated as cache miss.
+    if (entry.cached.has_value() && entry.cached->size() != collectToStackCalls(func).size())
+      entry.cached = std::nullopt;
+  }
+};
+
+struct StackPositionCacheStorer : public wasm::Pass {
+  std::string dir_;
+  std::shared_ptr<StackPositionCacheEntries const> entries_;
+  std::shared_ptr<StackPositions> stackPositions_;
+  StackPositionCacheStorer(std::string dir, std::shared_ptr<StackPositionCacheEntries const> entries,
+                           std::shared_ptr<StackPositions> stackPositions)
+      : dir_(std::move(dir)), entries_(std::move(entries)), stackPositions_(std::move(stackPositions)) {
+    name = "StackPositionCacheStorer";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<StackPositionCacheStorer>(dir_, entries_, stackPositions_);
+  }
+  bool modifiesBinaryenIR() override { return false; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override {
+    StackPositionCacheEntry const &entry = entries_->at(func);
+    StackPosition &stackPosition = stackPositions_->at(func);
+    std::vector<wasm::Call *> const calls = collectToStackCalls(func);
+    if (entry.cached.has_value()) {
+      std::vector<std::optional<uint32_t>> const &offsets = entry.cached.value();
+      assert(offsets.size() == calls.size() && "loader drops entries with mismatched size");
+      for (size_t i = 0; i < calls.size(); i++) {
+        if (offsets[i].has_value())
+          stackPosition.insert_or_assign(calls[i], offsets[i].value());
+      }
+      return;
+    }
+    std::vector<std::optional<uint32_t>> offsets{};
+    offsets.reserve(calls.size());
+    for (wasm::Call *call : calls) {
+      auto const it = stackPosition.find(call);
+      offsets.push_back(it == stackPosition.end() ? std::nullopt : std::optional<uint32_t>{it->second});
+    }
+    store(dir_, entry.key, offsets);
+  }
+};
+
+/// @brief run inner function parallel pass on functions which are not cached.
+struct CachedFunctionSkipper : public wasm::Pass {
+  std::unique_ptr<wasm::Pass> pass_;
+  std::shared_ptr<StackPositionCacheEntries const> entries_;
+  CachedFunctionSkipper(std::unique_ptr<wasm::Pass> pass, std::shared_ptr<StackPositionCacheEntries const> entries)
+      : pass_(std::move(pass)), entries_(std::move(entries)) {
+    name = pass_->name;
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override { return std::make_unique<CachedFunctionSkipper>(pass_->create(), entries_); }
+  bool modifiesBinaryenIR() override { return pass_->modifiesBinaryenIR(); }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override {
+    if (entries_->at(func).cached.has_value())
+      return;
+    pass_->setPassRunner(getPassRunner());
+    pass_->runOnFunction(m, func);
+  }
+};
+
+} // namespace
+
+std::shared_ptr<StackPositionCacheEntries>
+StackPositionCache::addLoadToPass(wasm::PassRunner &runner, std::string const &dir, std::string const &configKey,
+                                  std::shared_ptr<LeafFunc const> const &leaf,
+                                  std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
+                                  std::shared_ptr<ManagedParams const> const &managedParams) {
+  std::error_code ec{};
+  std::filesystem::create_directories(dir, ec);
+  auto entries = std::make_shared<StackPositionCacheEntries>();
+  for (std::unique_ptr<wasm::Function> const &f : runner.wasm->functions)
+    entries->insert_or_assign(f.get(), StackPositionCacheEntry{});
+  runner.add(
+      std::make_unique<StackPositionCacheLoader>(dir, configKey, leaf, indirectCallTargets, managedParams, entries));
+  return entries;
+}
+
+void StackPositionCache::addStoreToPass(wasm::PassRunner &runner, std::string const &dir,
+                                        std::shared_ptr<StackPositionCacheEntries const> const &entries,
+                                        std::shared_ptr<StackPositions> const &stackPositions) {
+  runner.add(std::make_unique<StackPositionCacheStorer>(dir, entries, stackPositions));
+}
+
+void CachedFunctionSkippingRunner::doAdd(std::unique_ptr<wasm::Pass> pass) {
+  if (entries_ != nullptr && pass->isFunctionParallel())
+    pass = std::make_unique<CachedFunctionSkipper>(std::move(pass), entries_);
+  LargestFirstPassRunner::doAdd(std::move(pass));
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+constexpr std::string_view cacheTestWat = R"(
+  (func $f (result i32)
+    (local i32)
+    (local.set 0 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+    (drop (call $~lib/rt/itcms/__new))
+    local.get 0
+  )
+)";
+
+std::string lowerWithCache(std::string const &dir) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  config.cacheDir = dir;
+  return toString(lowerGCTestWat(cacheTestWat, config)->getFunction("f"));
+}
+
+} // namespace
+
+TEST(StackPositionCacheTest, SameResultWithCache) {
+  std::filesystem::path const dir = std::filesystem::temp_directory_path() /
+                                    fmt::format("warpo-stack-position-cache-test-{}", getpid());
+  std::filesystem::remove_all(dir);
+
+  std::string const miss = lowerWithCache(dir.string());
+  EXPECT_FALSE(std::filesystem::is_empty(dir));
+  std::string const hit = lowerWithCache(dir.string());
+  EXPECT_EQ(miss, hit);
+  EXPECT_NE(hit.find("__tostack<0>"), std::string::npos);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST(StackPositionCacheTest, StaleEntryIsCacheMiss) {
+  std::filesystem::path const dir = std::filesystem::temp_directory_path() /
+                                    fmt::format("warpo-stack-position-cache-stale-test-{}", getpid());
+  std::filesystem::remove_all(dir);
+
+  std::string const miss = lowerWithCache(dir.string());
+  for (std::filesystem::directory_entry const &file : std::filesystem::directory_iterator{dir}) {
+    std::ofstream os{file.path(), std::ios::binary | std::ios::app};
+    os << "0 0 0 ";
+  }
+  std::string const stale = lowerWithCache(dir.string());
+  EXPECT_EQ(miss, stale);
+
+  std::filesystem::remove_all(dir);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../helper/LargestFirstScheduler.hpp"
+#include "CollectLeafFunction.hpp"
+#include "ManagedParams.hpp"
+#include "StackAssigner.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+struct StackPositionCacheEntry {
+  /// @brief function body, leaf status of callees and lowering config. It is compared on lookup to avoid hash collision.
+  std::string key;
+  /// @brief offsets of tostack calls in walking order, nullopt element means the call does not need a stack slot.
+  std::optional<std::vector<std::optional<uint32_t>>> cached;
+};
+using StackPositionCacheEntries = std::map<wasm::Function *, StackPositionCacheEntry>;
+
+/// @brief on-disk cache of StackAssigner results across builds.
+/// @details stack positions of a function only depend on its body, whether its callees are GC leaf functions, its
+/// managed params and the lowering config. Cached functions skip ObjLivenessAnalyzer, MergeSSA, LeafFunctionFilter and StackAssigner.
+struct StackPositionCache {
+  static std::shared_ptr<StackPositionCacheEntries>
+  addLoadToPass(wasm::PassRunner &runner, std::string const &dir, std::string const &configKey,
+                std::shared_ptr<LeafFunc const> const &leaf,
+                std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets,
+                std::shared_ptr<ManagedParams const> const &managedParams);
+  static void addStoreToPass(wasm::PassRunner &runner, std::string const &dir,
+                             std::shared_ptr<StackPositionCacheEntries const> const &entries,
+                             std::shared_ptr<StackPositions> const &stackPositions);
+};
+
+/// @brief pass runner which lets function parallel passes skip cached functions while skipping is enabled.
+struct CachedFunctionSkippingRunner : public LargestFirstPassRunner {
+  using LargestFirstPassRunner::LargestFirstPassRunner;
+  /// @brief function parallel passes added afterwards skip cached functions in entries, nullptr disables skipping.
+  void setSkipping(std::shared_ptr<StackPositionCacheEntries const> entries) { entries_ = std::move(entries); }
+
+protected:
+  void doAdd(std::unique_ptr<wasm::Pass> pass) override;
+
+private:
+  std::shared_ptr<StackPositionCacheEntries const> entries_;
+};
+
+} // namespace warpo::passes::gc
@@ -0,0 +1,304 @@
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "../helper/CFG.hpp"
+#include "../helper/GenKillDataflow.hpp"
+#include "GCInfo.hpp"
+#include "StackAssigner.hpp"
+#include "ToStackStoreOptimizer.hpp"
+#include "fmt/base.h"
+#include "ir/find_all.h"
+#include "ir/utils.h"
+#include "support/Debug.hpp"
+#include "support/DynBitSet.hpp"
+#include "support/Range.hpp"
+#include "wasm-builder.h"
+#include "wasm-traversal.h"
+#include "wasm.h"
+
+#define PASS_NAME "ToStackStoreOptimizer"
+#define DEBUG_PREFIX "[ToStackStoreOptimizer] "
+
+namespace warpo::passes::gc {
+
+namespace {
+
+/// @brief tostack calls in lowered function body and their offsets.
+using SlotMap = std::map<wasm::Call *, uint32_t>;
+/// @brief the only local whose values are stored to each slot, nullopt when the slot stores values of different locals
+/// or temporary values.
+using SlotOwners = std::map<uint32_t, std::optional<wasm::Index>>;
+
+bool isFrameBoundary(wasm::Name const &target) {
+  return target == FnDecreaseSP || target == FnDecreaseSPWithoutFill || target == FnDecreaseSPWithoutCheck ||
+         target == FnDecreaseSPWithoutFillAndCheck || target == FnIncreaseSP;
+}
+
+std::optional<wasm::Index> getStoredLocal(wasm::Call *call) {
+  if (auto *get = call->operands.front()->dynCast<wasm::LocalGet>())
+    return get->index;
+  return std::nullopt;
+}
+
+struct ToStackStoreCollector : public wasm::PostWalker<ToStackStoreCollector> {
+  StackPosition const &stackPosition_;
+  SlotMap slots_{};
+  /// @brief local which is set to the result of tostack call
+  std::map<wasm::Call *, wasm::Index> setLocals_{};
+  explicit ToStackStoreCollector(StackPosition const &stackPosition) : stackPosition_(stackPosition) {}
+  void visitCall(wasm::Call *expr) {
+    auto const it = stackPosition_.find(expr);
+    if (it != stackPosition_.end())
+      slots_.insert_or_assign(expr, it->second);
+  }
+  void visitLocalSet(wasm::LocalSet *expr) {
+    auto *call = expr->value->dynCast<wasm::Call>();
+    if (call != nullptr && slots_.contains(call))
+      setLocals_.insert_or_assign(call, expr->index);
+  }
+
+  /// @brief local whose value is stored by call
+  std::optional<wasm::Index> getLocal(wasm::Call *call) const {
+    auto const it = setLocals_.find(call);
+    return it != setLocals_.end() ? it->second : getStoredLocal(call);
+  }
+  SlotOwners getSlotOwners() const {
+    SlotOwners owners{};
+    for (auto const &[call, offset] : slots_) {
+      std::optional<wasm::Index> const local = getLocal(call);
+      auto const [it, inserted] = owners.try_emplace(offset, local);
+      if (!inserted && it->second != local)
+        it->second = std::nullopt;
+    }
+    return owners;
+  }
+};
+
+/// @brief hoist `tostack(local.get $x)` in front of loop when $x is not changed in the loop.
+/// @details the slot must only store values of $x in the whole function, otherwise storing earlier may overwrite a live
+/// value of another local. The loop must be in statement position, so no value is pending on the value stack.
+struct LoopInvariantStoreHoister : public wasm::ExpressionStackWalker<LoopInvariantStoreHoister> {
+  SlotMap &slots_;
+  SlotOwners const &owners_;
+  size_t hoistedCount_ = 0U;
+  LoopInvariantStoreHoister(SlotMap &slots, SlotOwners const &owners) : slots_(slots), owners_(owners) {}
+
+  void visitLoop(wasm::Loop *expr) {
+    if (!isStatement())
+      return;
+    std::set<wasm::Index> assigned{};
+    for (wasm::LocalSet *set : wasm::FindAll<wasm::LocalSet>(expr).list)
+      assigned.insert(set->index);
+    // inner loops are visited first, so stores hoisted from them are hoisted further here when possible
+    std::map<uint32_t, wasm::Call *> invariantStores{};
+    for (wasm::Call *call : wasm::FindAll<wasm::Call>(expr).list) {
+      auto const slotIt = slots_.find(call);
+      if (slotIt == slots_.end())
+        continue;
+      std::optional<wasm::Index> const local = getStoredLocal(call);
+      if (!local.has_value() || assigned.contains(local.value()) || owners_.at(slotIt->second) != local)
+        continue;
+      invariantStores.try_emplace(slotIt->second, call);
+    }
+    if (invariantStores.empty())
+      return;
+    wasm::Builder b{*getModule()};
+    std::vector<wasm::Expression *> items{};
+    for (auto const &[offset, call] : invariantStores) {
+      auto *const hoisted = wasm::ExpressionManipulator::copy(call, *getModule())->cast<wasm::Call>();
+      slots_.insert_or_assign(hoisted, offset);
+      items.push_back(b.makeDrop(hoisted));
+    }
+    items.push_back(expr);
+    replaceCurrent(b.makeBlock(items, expr->type));
+    hoistedCount_ += invariantStores.size();
+  }
+
+private:
+  bool isStatement() const {
+    for (size_t i = expressionStack.size() - 1U; i > 0U; i--) {
+      wasm::Expression *const parent = expressionStack[i - 1U];
+      wasm::Expression *const child = expressionStack[i];
+      if (parent->is<wasm::Block>() || parent->is<wasm::Loop>())
+        continue;
+      if (auto *iff = parent->dynCast<wasm::If>(); iff != nullptr && iff->condition != child)
+        continue;
+      return false;
+    }
+    return true;
+  }
+};
+
+/// @brief bit of each (offset, local) pair means the slot possibly does not hold the current value of the local.
+struct UnheldSlotTransferFn : public IGenKillTransfer {
+  SlotMap const &slots_;
+  ToStackStoreCollector const &collector_;
+  std::map<std::pair<uint32_t, wasm::Index>, size_t> pairs_{};
+  std::map<uint32_t, std::vector<size_t>> pairsOfSlot_{};
+  std::map<wasm::Index, std::vector<size_t>> pairsOfLocal_{};
+  std::set<wasm::Call *> redundantStores_{};
+
+  UnheldSlotTransferFn(SlotMap const &slots, ToStackStoreCollector const &collector)
+      : slots_(slots), collector_(collector) {
+    for (auto const &[call, offset] : slots_) {
+      std::optional<wasm::Index> const local = collector_.getLocal(call);
+      if (!local.has_value())
+        continue;
+      auto const [it, inserted] = pairs_.try_emplace(std::make_pair(offset, local.value()), pairs_.size());
+      if (!inserted)
+        continue;
+      pairsOfSlot_[offset].push_back(it->second);
+      pairsOfLocal_[local.value()].push_back(it->second);
+    }
+  }
+
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    if (auto *call = expr->dynCast<wasm::Call>()) {
+      if (isFrameBoundary(call->target)) {
+        for (size_t const index : Range{pairs_.size()})
+          effect.gen(index);
+        return;
+      }
+      auto const slotIt = slots_.find(call);
+      if (slotIt == slots_.end())
+        return;
+      for (size_t const index : pairsOfSlot_[slotIt->second])
+        effect.gen(index);
+      std::optional<wasm::Index> const local = getStoredLocal(call);
+      if (local.has_value())
+        effect.kill(pairs_.at(std::make_pair(slotIt->second, local.value())));
+    } else if (auto *set = expr->dynCast<wasm::LocalSet>()) {
+      for (size_t const index : pairsOfLocal_[set->index])
+        effect.gen(index);
+      auto *call = set->value->dynCast<wasm::Call>();
+      auto const slotIt = call == nullptr ? slots_.end() : slots_.find(call);
+      if (slotIt != slots_.end())
+        effect.kill(pairs_.at(std::make_pair(slotIt->second, set->index)));
+    }
+  }
+
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    auto *call = expr->dynCast<wasm::Call>();
+    if (call == nullptr)
+      return;
+    auto const slotIt = slots_.find(call);
+    if (slotIt == slots_.end())
+      return;
+    std::optional<wasm::Index> const local = getStoredLocal(call);
+    if (local.has_value() && !state.get(pairs_.at(std::make_pair(slotIt->second, local.value()))))
+      redundantStores_.insert(call);
+  }
+};
+
+} // namespace
+
+void ToStackStoreOptimizer::runOnFunction(wasm::Module *m, wasm::Function *func) {
+  auto const stackPositionIt = stackPositions_->find(func);
+  if (stackPositionIt == stackPositions_->end())
+    return;
+  ToStackStoreCollector collector{stackPositionIt->second};
+  collector.walk(func->body);
+  if (collector.slots_.empty())
+    return;
+
+  SlotOwners const owners = collector.getSlotOwners();
+  LoopInvariantStoreHoister hoister{collector.slots_, owners};
+  hoister.walkFunctionInModule(func, m);
+
+  CFG const cfg = CFG::fromFunction(func);
+  UnheldSlotTransferFn transfer{collector.slots_, collector};
+  GenKillDataflow dataflow{cfg, transfer.pairs_.size(), DataflowDirection::Forward, transfer};
+  DynBitset boundary{transfer.pairs_.size()};
+  for (size_t const index : Range{transfer.pairs_.size()})
+    boundary.set(index, true);
+  dataflow.setBoundary(boundary);
+  dataflow.solve();
+  dataflow.collectResults();
+
+  struct RedundantStoreRemover : public wasm::PostWalker<RedundantStoreRemover> {
+    std::set<wasm::Call *> const &redundantStores_;
+    explicit RedundantStoreRemover(std::set<wasm::Call *> const &redundantStores)
+        : redundantStores_(redundantStores) {}
+    void visitCall(wasm::Call *expr) {
+      if (redundantStores_.contains(expr))
+        replaceCurrent(expr->operands.front());
+    }
+  };
+  RedundantStoreRemover remover{transfer.redundantStores_};
+  remover.walk(func->body);
+
+  if (support::isDebug(PASS_NAME, func->name.str))
+    fmt::println(DEBUG_PREFIX "'{}': hoist {} stores, remove {} redundant stores", func->name.str,
+                 hoister.hoistedCount_, transfer.redundantStores_.size());
+}
+
+} // namespace warpo::passes::gc
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Lowering.hpp"
+#include "LoweringTestHelper.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+std::unique_ptr<wasm::Module> lowerWithToStackStoreOptimizer(std::string_view funcWat) {
+  GCLowering::Config config = GCLowering::getDefaultConfig();
+  // keep re-rooting of locals by __tmptostack
+  config.mergeSSA = false;
+  config.optimizeToStackStores = true;
+  return lowerGCTestWat(funcWat, config);
+}
+
+} // namespace
+
+TEST(ToStackStoreOptimizerTest, HoistLoopInvariantStore) {
+  std::unique_ptr<wasm::Module> m = lowerWithToStackStoreOptimizer(R"(
+    (func $f (param i32)
+      (local i32)
+      (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+      (loop $l
+        (call $use (call $~lib/rt/__tmptostack (local.get 1)) (call $~lib/rt/itcms/__new))
+        (br_if $l (local.get 0))
+      )
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  std::vector<wasm::Loop *> const loops = wasm::FindAll<wasm::Loop>(f->body).list;
+  ASSERT_EQ(loops.size(), 1U);
+  EXPECT_EQ(countToStackStores(loops.front()), 0U);
+  EXPECT_EQ(countToStackStores(f->body), 2U);
+}
+
+TEST(ToStackStoreOptimizerTest, KeepStoreOfChangedLocal) {
+  std::unique_ptr<wasm::Module> m = lowerWithToStackStoreOptimizer(R"(
+    (func $f (param i32)
+      (local i32)
+      (loop $l
+        (local.set 1 (call $~lib/rt/__localtostack (call $~lib/rt/itcms/__new)))
+        (call $use (call $~lib/rt/__tmptostack (local.get 1)) (call $~lib/rt/itcms/__new))
+        (br_if $l (local.get 0))
+      )
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  std::vector<wasm::Loop *> const loops = wasm::FindAll<wasm::Loop>(f->body).list;
+  ASSERT_EQ(loops.size(), 1U);
+  EXPECT_EQ(countToStackStores(loops.front()), countToStackStores(f->body));
+  EXPECT_GE(countToStackStores(loops.front()), 1U);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <memory>
+
+#include "StackAssigner.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes::gc {
+
+/// @brief optimize `__tostack<{offset}>` stores of lowered function.
+/// @details stores of a local which are invariant in a loop are hoisted in front of the loop, then stores whose slot
+/// already holds the current value of the local on all incoming paths are removed.
+struct ToStackStoreOptimizer : public wasm::Pass {
+  std::shared_ptr<StackPositions const> stackPositions_;
+  explicit ToStackStoreOptimizer(std::shared_ptr<StackPositions const> const &stackPositions)
+      : stackPositions_(stackPositions) {
+    name = "ToStackStoreOptimizer";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override { return std::make_unique<ToStackStoreOptimizer>(stackPositions_); }
+  bool modifiesBinaryenIR() override { return true; }
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override;
+};
+
+} // namespace warpo::passes::gc
@@ -0,0 +1,323 @@
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "AdvancedInlining.hpp"
+#include "ExtractMostFrequentlyUsedGlobals.hpp"
+#include "GC/Lowering.hpp"
+#include "Pipeline.hpp"
+#include "helper/TimeReport.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+namespace {
+
+constexpr std::string_view defaultPipelineSpec = R"(gc-lowering
+default(optimize=0, shrink=2), advanced-inlining(optimize=0, shrink=2)
+extract-most-frequently-used-globals
+default(optimize=0, shrink=2)
+)";
+
+class PipelineParser {
+  std::string src_;
+  size_t pos_ = 0U;
+
+public:
+  explicit PipelineParser(std::string_view spec) : src_(spec) {
+    // comments become spaces and new lines become stage separators, so offsets in error message are kept.
+    bool inComment = false;
+    for (char &c : src_) {
+      if (c == '\n') {
+        inComment = false;
+        c = ';';
+      } else if (c == '#' || inComment) {
+        inComment = true;
+        c = ' ';
+      }
+    }
+  }
+
+  Pipeline parse() {
+    Pipeline pipeline{};
+    while (true) {
+      skipSpaces();
+      if (pos_ == src_.size())
+        break;
+      if (consume(';'))
+        continue;
+      pipeline.push_back(parseStage());
+      skipSpaces();
+      if (pos_ != src_.size())
+        expect(';');
+    }
+    return pipeline;
+  }
+
+private:
+  std::invalid_argument error(std::string const &msg) const {
+    return std::invalid_argument{fmt::format("invalid pipeline at offset {}: {}", pos_, msg)};
+  }
+  static bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.' || c == '@' || c == '/';
+  }
+  void skipSpaces() {
+    while (pos_ < src_.size() && std::isspace(static_cast<unsigned char>(src_[pos_])))
+      pos_++;
+  }
+  bool consume(char c) {
+    skipSpaces();
+    if (pos_ < src_.size() && src_[pos_] == c) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+  void expect(char c) {
+    if (!consume(c))
+      throw error(fmt::format("expected '{}'", c));
+  }
+  std::string parseWord() {
+    skipSpaces();
+    size_t const begin = pos_;
+    while (pos_ < src_.size() && isWordChar(src_[pos_]))
+      pos_++;
+    if (begin == pos_)
+      throw error("expected name or value");
+    return src_.substr(begin, pos_ - begin);
+  }
+
+  PipelineStage parseStage() {
+    PipelineStage stage{};
+    do {
+      stage.passes.push_back(parsePass());
+    } while (consume(','));
+    if (consume('*')) {
+      std::string const count = parseWord();
+      uint32_t repetition = 0U;
+      auto const [ptr, ec] = std::from_chars(count.data(), count.data() + count.size(), repetition);
+      if (ec != std::errc{} || ptr != count.data() + count.size() || repetition == 0U)
+        throw error(fmt::format("invalid repetition '{}'", count));
+      stage.repetition = repetition;
+    }
+    return stage;
+  }
+  PipelinePass parsePass() {
+    PipelinePass pass{.name = parseWord(), .params = {}};
+    if (!consume('(') || consume(')'))
+      return pass;
+    do {
+      std::string key = parseWord();
+      expect('=');
+      std::string value = parseWord();
+      if (!pass.params.emplace(key, std::move(value)).second)
+        throw error(fmt::format("duplicated param '{}'", key));
+    } while (consume(','));
+    expect(')');
+    return pass;
+  }
+};
+
+/// @brief read params of one pass, every param must be read exactly once.
+class ParamReader {
+  std::string const &passName_;
+  std::map<std::string, std::string> params_;
+
+public:
+  explicit ParamReader(PipelinePass const &pass) : passName_(pass.name), params_(pass.params) {}
+
+  std::optional<std::string> take(std::string const &key) {
+    auto const it = params_.find(key);
+    if (it == params_.end())
+      return std::nullopt;
+    std::string value = std::move(it->second);
+    params_.erase(it);
+    return value;
+  }
+  bool takeBool(std::string const &key, bool defaultValue) {
+    std::optional<std::string> const value = take(key);
+    if (!value.has_value())
+      return defaultValue;
+    if (value == "true")
+      return true;
+    if (value == "false")
+      return false;
+    throw std::invalid_argument{fmt::format("param '{}' of pass '{}' expects true or false", key, passName_)};
+  }
+  std::optional<int> takeLevel(std::string const &key) {
+    std::optional<std::string> const value = take(key);
+    if (!value.has_value())
+      return std::nullopt;
+    int level = 0;
+    auto const [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), level);
+    if (ec != std::errc{} || ptr != value->data() + value->size() || level < 0 || level > 4)
+      throw std::invalid_argument{fmt::format("param '{}' of pass '{}' expects level 0-4", key, passName_)};
+    return level;
+  }
+  void ensureAllTaken() const {
+    if (!params_.empty())
+      throw std::invalid_argument{fmt::format("unknown param '{}' of pass '{}'", params_.begin()->first, passName_)};
+  }
+};
+
+/// @brief run pass in nested runner with its own optimize and shrink level.
+/// @details null pass means binaryen default optimization passes.
+struct LeveledPass : public wasm::Pass {
+  std::unique_ptr<wasm::Pass> pass_;
+  std::optional<int> optimizeLevel_;
+  std::optional<int> shrinkLevel_;
+  LeveledPass(std::unique_ptr<wasm::Pass> pass, std::optional<int> optimizeLevel, std::optional<int> shrinkLevel)
+      : pass_(std::move(pass)), optimizeLevel_(optimizeLevel), shrinkLevel_(shrinkLevel) {
+    name = pass_ == nullptr ? "DefaultOptimization" : pass_->name;
+  }
+  // after effects are handled by the nested runner
+  bool modifiesBinaryenIR() override { return false; }
+  void run(wasm::Module *m) override {
+    if (pass_ == nullptr) {
+      TimedPassRunner runner{getPassRunner()};
+      setupLevels(runner);
+      runner.addDefaultOptimizationPasses();
+      runner.run();
+      return;
+    }
+    // single pass is already recorded in time report with the name of this pass
+    wasm::PassRunner runner{getPassRunner()};
+    setupLevels(runner);
+    runner.add(std::move(pass_));
+    runner.run();
+  }
+
+private:
+  void setupLevels(wasm::PassRunner &runner) const {
+    runner.setDebug(false);
+    if (optimizeLevel_.has_value())
+      runner.options.optimizeLevel = optimizeLevel_.value();
+    if (shrinkLevel_.has_value())
+      runner.options.shrinkLevel = shrinkLevel_.value();
+  }
+};
+
+} // namespace
+
+std::string_view getDefaultPipelineSpec() { return defaultPipelineSpec; }
+
+Pipeline parsePipeline(std::string_view spec) {
+  Pipeline pipeline = PipelineParser{spec}.parse();
+  // report unknown pass and param before running anything
+  for (PipelineStage const &stage : pipeline) {
+    for (PipelinePass const &pass : stage.passes)
+      createPipelinePass(pass);
+  }
+  return pipeline;
+}
+
+std::string toString(PipelineStage const &stage) {
+  std::string ret{};
+  for (PipelinePass const &pass : stage.passes) {
+    if (!ret.empty())
+      ret += ",";
+    ret += pass.name;
+    if (pass.params.empty())
+      continue;
+    std::string params{};
+    for (auto const &[key, value] : pass.params)
+      params += fmt::format("{}{}={}", params.empty() ? "" : ",", key, value);
+    ret += fmt::format("({})", params);
+  }
+  if (stage.repetition != 1U)
+    ret += fmt::format("*{}", stage.repetition);
+  return ret;
+}
+
+std::unique_ptr<wasm::Pass> createPipelinePass(PipelinePass const &pass) {
+  ParamReader params{pass};
+  std::optional<int> const optimizeLevel = params.takeLevel("optimize");
+  std::optional<int> const shrinkLevel = params.takeLevel("shrink");
+  std::unique_ptr<wasm::Pass> ret{};
+  if (pass.name == "default") {
+    // default passes are only added by a runner
+  } else if (pass.name == "gc-lowering") {
+    GCLowering::Config config = GCLowering::getDefaultConfig();
+    config.leafFunctionFilter = params.takeBool("leaf-function-filter", config.leafFunctionFilter);
+    config.returningCollectionSummary =
+        params.takeBool("returning-collection-summary", config.returningCollectionSummary);
+    config.mergeSSA = params.takeBool("merge-ssa", config.mergeSSA);
+    config.optimizedStackPositionAssigner =
+        params.takeBool("optimized-stack-position-assigner", config.optimizedStackPositionAssigner);
+    config.optimalStackPositionAssigner =
+        params.takeBool("optimal-stack-position-assigner", config.optimalStackPositionAssigner);
+    config.shrinkWrap = params.takeBool("shrink-wrap", config.shrinkWrap);
+    config.elideFrameFill = params.takeBool("elide-frame-fill", config.elideFrameFill);
+    config.interproceduralStackCheck = params.takeBool("interprocedural-stack-check", config.interproceduralStackCheck);
+    config.lazyRootSpilling = params.takeBool("lazy-root-spilling", config.lazyRootSpilling);
+    config.optimizeToStackStores = params.takeBool("optimize-tostack-stores", config.optimizeToStackStores);
+    config.fusedLowering = params.takeBool("fused-lowering", config.fusedLowering);
+    if (std::optional<std::string> cacheDir = params.take("cache-dir"))
+      config.cacheDir = std::move(cacheDir).value();
+    ret = std::make_unique<GCLowering>(config);
+  } else if (pass.name == "advanced-inlining") {
+    ret.reset(createAdvancedInliningPass());
+  } else if (pass.name == "extract-most-frequently-used-globals") {
+    ret.reset(createExtractMostFrequentlyUsedGlobalsPass());
+  } else if (wasm::PassRegistry::get()->containsPass(pass.name)) {
+    ret = wasm::PassRegistry::get()->createPass(pass.name);
+    if (std::optional<std::string> const arg = params.take("arg"))
+      ret->setPassArg(arg.value());
+  } else {
+    throw std::invalid_argument{fmt::format("unknown pass '{}'", pass.name)};
+  }
+  params.ensureAllTaken();
+  if (ret == nullptr || optimizeLevel.has_value() || shrinkLevel.has_value())
+    return std::make_unique<LeveledPass>(std::move(ret), optimizeLevel, shrinkLevel);
+  return ret;
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+
+namespace warpo::passes::ut {
+
+TEST(PipelineTest, ParseDefault) {
+  Pipeline const pipeline = parsePipeline(getDefaultPipelineSpec());
+  ASSERT_EQ(pipeline.size(), 4U);
+  EXPECT_EQ(toString(pipeline[0]), "gc-lowering");
+  EXPECT_EQ(toString(pipeline[1]), "default(optimize=0,shrink=2),advanced-inlining(optimize=0,shrink=2)");
+  EXPECT_EQ(toString(pipeline[2]), "extract-most-frequently-used-globals");
+  EXPECT_EQ(toString(pipeline[3]), "default(optimize=0,shrink=2)");
+}
+
+TEST(PipelineTest, ParseRepetitionAndComment) {
+  Pipeline const pipeline = parsePipeline("# comment\n gc-lowering(merge-ssa=false) ; vacuum, precompute * 3 # tail");
+  ASSERT_EQ(pipeline.size(), 2U);
+  EXPECT_EQ(pipeline[0].passes[0].params.at("merge-ssa"), "false");
+  EXPECT_EQ(pipeline[1].passes.size(), 2U);
+  EXPECT_EQ(pipeline[1].repetition, 3U);
+  EXPECT_EQ(toString(pipeline[1]), "vacuum,precompute*3");
+}
+
+TEST(PipelineTest, Invalid) {
+  EXPECT_THROW(parsePipeline("gc-lowering("), std::invalid_argument);
+  EXPECT_THROW(parsePipeline("vacuum*0"), std::invalid_argument);
+  EXPECT_THROW(parsePipeline("not-a-pass"), std::invalid_argument);
+  EXPECT_THROW(parsePipeline("gc-lowering(merge-ssa=maybe)"), std::invalid_argument);
+  EXPECT_THROW(parsePipeline("gc-lowering(unknown=true)"), std::invalid_argument);
+  EXPECT_THROW(parsePipeline("default(optimize=5)"), std::invalid_argument);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
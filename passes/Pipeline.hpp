@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pass.h"
+
+namespace warpo::passes {
+
+struct PipelinePass {
+  std::string name;
+  std::map<std::string, std::string> params;
+};
+
+/// @brief passes which run together, the module is validated after each stage.
+struct PipelineStage {
+  std::vector<PipelinePass> passes;
+  uint32_t repetition = 1U;
+};
+
+using Pipeline = std::vector<PipelineStage>;
+
+/// @brief pipeline used when no pipeline is given in command line.
+std::string_view getDefaultPipelineSpec();
+
+/// @brief parse pipeline spec, throws std::invalid_argument for syntax error and unknown pass or param.
+/// @details stages are separated by ';' or new line, passes in one stage are separated by ','.
+/// `name(key=value, ...)` gives params to a pass, `*N` after a stage repeats it N times, '#' starts a comment.
+Pipeline parsePipeline(std::string_view spec);
+
+/// @brief text of the stage in canonical format, used as stage name in report.
+std::string toString(PipelineStage const &stage);
+
+/// @brief create pass from its pipeline description, throws std::invalid_argument for unknown pass or param.
+std::unique_ptr<wasm::Pass> createPipelinePass(PipelinePass const &pass);
+
+} // namespace warpo::passes
@@ -1,20 +1,34 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <fmt/base.h>
 #include <fmt/format.h>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
 #include <regex>
 #include <sstream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "AdvancedInlining.hpp"
-#include "ExtractMostFrequentlyUsedGlobals.hpp"
 #include "GC/Lowering.hpp"
+#include "Pipeline.hpp"
 #include "Runner.hpp"
 #include "binaryen-c.h"
+#include "helper/IncrementalValidator.hpp"
+#include "helper/TimeReport.hpp"
 #include "helper/ToString.hpp"
 #include "parser/wat-parser.h"
+#include "parsing.h"
 #include "pass.h"
 #include "passes/Runner.hpp"
+#include "support/MappedFile.hpp"
 #include "support/Opt.hpp"
 #include "wasm-binary.h"
 #include "wasm-features.h"
@@ -32,20 +46,111 @@ static const cli::Opt<bool> EnableAdvancedInliningPassForTesting{
     [](argparse::Argument &arg) { arg.help("Enable advanced inlining pass").flag().hidden(); },
 };
 
+static cli::Opt<std::string> TimeReportFormat{
+    "--time-report",
+    [](argparse::Argument &arg) {
+      arg.help("Report wall time, cpu time and RSS change of each stage and pass to stderr")
+          .nargs(0, 1)
+          .choices("text", "json");
+    },
+};
+
+static const cli::Opt<bool> IncrementalValidation{
+    "--incremental-validation",
+    [](argparse::Argument &arg) {
+      arg.help("Only validate functions changed by the previous stage between pipeline stages").flag();
+    },
+};
+
+static cli::Opt<std::string> PipelineSpec{
+    "--pipeline",
+    [](argparse::Argument &arg) {
+      arg.help("Pipeline to run instead of the default one, stages are separated by ';' and passes by ','");
+    },
+};
+static cli::Opt<std::string> PipelineFile{
+    "--pipeline-file",
+    [](argparse::Argument &arg) { arg.help("File which contains the pipeline to run, one stage per line"); },
+};
+
+static cli::Opt<uint32_t> Threads{
+    "--threads",
+    [](argparse::Argument &arg) {
+      arg.help("Number of threads for function parallel passes, default is the number of cores");
+    },
+};
+
+namespace {
+/// @brief collect time report on current thread when it is requested in command line.
+class TimeReportSession {
+  std::unique_ptr<passes::TimeReport> report_;
+
+public:
+  TimeReportSession() {
+    if (!TimeReportFormat.isUsed())
+      return;
+    report_ = std::make_unique<passes::TimeReport>();
+    passes::TimeReport::setCurrent(report_.get());
+  }
+  ~TimeReportSession() {
+    if (report_ == nullptr)
+      return;
+    passes::TimeReport::setCurrent(nullptr);
+    if (TimeReportFormat.get() == "json")
+      report_->printJson(std::cerr);
+    else
+      report_->print(std::cerr);
+  }
+};
+} // namespace
+
 static void ensureValidate(wasm::Module &m) {
+  passes::TimeReport::Scope const scope{"validate"};
   if (!wasm::WasmValidator{}.validate(m))
     throw std::logic_error("validate error");
 }
 
+namespace {
+/// @brief validation between pipeline stages, only changed functions are validated with incremental validation.
+class StageValidator {
+  wasm::Module &m_;
+  std::optional<passes::IncrementalValidator> incremental_;
+
+public:
+  explicit StageValidator(wasm::Module &m) : m_(m) {
+    if (!IncrementalValidation.get())
+      return;
+    passes::TimeReport::Scope const scope{"validate"};
+    incremental_.emplace(m);
+  }
+  void validate() {
+    if (!incremental_.has_value()) {
+      ensureValidate(m_);
+      return;
+    }
+    passes::TimeReport::Scope const scope{"validate"};
+    if (!incremental_->validateChanged())
+      throw std::logic_error("validate error");
+  }
+};
+} // namespace
+
 std::unique_ptr<wasm::Module> passes::loadWasm(const std::vector<char> &input) {
+  passes::TimeReport::Scope const scope{"parse"};
   std::unique_ptr<wasm::Module> m{new wasm::Module()};
   wasm::WasmBinaryReader parser(*m, features, input);
-  parser.read();
+  try {
+    parser.read();
+  } catch (wasm::ParseException const &e) {
+    // ParseException is not a std::exception, callers outside of passes only see standard exceptions.
+    throw std::logic_error(e.text);
+  }
   ensureValidate(*m);
   return m;
 }
 
 std::unique_ptr<wasm::Module> passes::loadWat(std::string_view wat) {
+  passes::TimeReport::Scope const scope{"parse"};
   std::unique_ptr<wasm::Module> m{new wasm::Module()};
   m->features = features;
   auto parsed = wasm::WATParser::parseModule(*m, wat);
@@ -57,63 +162,109 @@ std::unique_ptr<wasm::Module> passes::loadWat(std::string_view wat) {
 
 void passes::init() { Colors::setEnabled(false); }
 
-static std::vector<uint8_t> outputWasm(wasm::Module *m) {
+static wasm::BufferWithRandomAccess writeWasm(wasm::Module *m) {
   wasm::BufferWithRandomAccess buffer;
   wasm::WasmBinaryWriter writer(m, buffer, wasm::PassOptions::getWithoutOptimization());
   writer.setNamesSection(false);
   writer.setEmitModuleName(false);
   writer.write();
-  return static_cast<std::vector<uint8_t>>(buffer);
+  return buffer;
 }
-static std::string outputWat(wasm::Module *m) {
-  std::stringstream ss{};
-  wasm::printStackIR(ss, m, wasm::PassOptions::getWithoutOptimization());
-  return std::move(ss).str();
+static void emitWasm(wasm::Module *m, std::ostream &os) {
+  // binary writer needs random access to patch section sizes, so the buffer is written out as a whole.
+  wasm::BufferWithRandomAccess const buffer = writeWasm(m);
+  os.write(reinterpret_cast<char const *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+}
+static void emitWat(wasm::Module *m, std::ostream &os) {
+  wasm::printStackIR(os, m, wasm::PassOptions::getWithoutOptimization());
 }
 
-passes::Output passes::runOnWat(std::string const &input) {
-  std::unique_ptr<wasm::Module> m = passes::loadWat(input);
-  {
-    wasm::PassRunner passRunner(m.get());
-    passRunner.add(std::unique_ptr<wasm::Pass>{new passes::GCLowering()});
-    passRunner.run();
-  }
-#ifndef WARPO_RELEASE_BUILD
-  ensureValidate(*m);
-#endif
-  {
-    wasm::PassRunner defaultOptRunner{m.get()};
-    defaultOptRunner.options.shrinkLevel = 2;
-    defaultOptRunner.options.optimizeLevel = 0;
-    defaultOptRunner.setDebug(false);
-    defaultOptRunner.addDefaultOptimizationPasses();
-    defaultOptRunner.add(std::unique_ptr<wasm::Pass>{passes::createAdvancedInliningPass()});
-    defaultOptRunner.run();
+static void emit(wasm::Module *m, passes::OutputStreams const &outputs) {
+  passes::TimeReport::Scope const scope{"emit"};
+  if (outputs.wasm != nullptr)
+    emitWasm(m, *outputs.wasm);
+  if (outputs.wat != nullptr)
+    emitWat(m, *outputs.wat);
+}
+
+static passes::Pipeline getPipeline() {
+  if (PipelineSpec.isUsed() && PipelineFile.isUsed())
+    throw std::invalid_argument{"--pipeline and --pipeline-file cannot be used together"};
+  if (PipelineFile.isUsed()) {
+    std::optional<MappedFile> const file = MappedFile::open(PipelineFile.get());
+    if (!file.has_value())
+      throw std::invalid_argument{fmt::format("failed to open pipeline file: {}", PipelineFile.get())};
+    return passes::parsePipeline(file->view());
   }
+  if (PipelineSpec.isUsed())
+    return passes::parsePipeline(PipelineSpec.get());
+  return passes::parsePipeline(passes::getDefaultPipelineSpec());
+}
+
+static void applyThreads() {
+  if (Threads.get() == 0U)
+    return;
+  // binaryen thread pool reads it when the pool is created at the first parallel work, e.g. validation after loading.
+  // modules can be optimized concurrently in batch mode, so the environment is only written once.
+  static std::once_flag once{};
+  std::call_once(once, []() { setenv("BINARYEN_CORES", std::to_string(Threads.get()).c_str(), 1); });
+}
+
+static void runPipeline(std::unique_ptr<wasm::Module> const &m) {
+  passes::Pipeline const pipeline = getPipeline();
 #ifndef WARPO_RELEASE_BUILD
-  ensureValidate(*m);
+  StageValidator stageValidator{*m};
 #endif
-  {
-    wasm::PassRunner passRunner(m.get());
-    passRunner.add(std::unique_ptr<wasm::Pass>{passes::createExtractMostFrequentlyUsedGlobalsPass()});
-    passRunner.run();
-  }
+  for (size_t stageIndex = 0U; stageIndex < pipeline.size(); stageIndex++) {
+    passes::PipelineStage const &stage = pipeline[stageIndex];
+    std::string const stageName = passes::toString(stage);
+    for (uint32_t repetition = 0U; repetition < stage.repetition; repetition++) {
+      {
+        passes::TimeReport::Scope const scope{stageName};
+        passes::TimedPassRunner passRunner{m.get()};
+        for (passes::PipelinePass const &pass : stage.passes)
+          passRunner.add(passes::createPipelinePass(pass));
+        passRunner.run();
+      }
 #ifndef WARPO_RELEASE_BUILD
-  ensureValidate(*m);
+      bool const isLastRun = stageIndex + 1U == pipeline.size() && repetition + 1U == stage.repetition;
+      if (!isLastRun)
+        stageValidator.validate();
 #endif
-  {
-    wasm::PassRunner defaultOptRunner{m.get()};
-    defaultOptRunner.options.shrinkLevel = 2;
-    defaultOptRunner.options.optimizeLevel = 0;
-    defaultOptRunner.setDebug(false);
-    defaultOptRunner.addDefaultOptimizationPasses();
-    defaultOptRunner.run();
+    }
   }
+  // module level checks are not covered by incremental validation
   ensureValidate(*m);
-  return {.wat = outputWat(m.get()), .wasm = outputWasm(m.get())};
 }
 
-std::string passes::runOnWatForTesting(std::string const &input, std::regex const &targetFunctionRegex) {
+passes::Output passes::runOnWat(std::string_view input) {
+  applyThreads();
+  TimeReportSession const timeReportSession{};
+  std::unique_ptr<wasm::Module> const m = passes::loadWat(input);
+  runPipeline(m);
+  std::stringstream wat{};
+  emitWat(m.get(), wat);
+  return {.wat = std::move(wat).str(), .wasm = std::vector<uint8_t>(writeWasm(m.get()))};
+}
+
+void passes::runOnWat(std::string_view input, OutputStreams const &outputs) {
+  applyThreads();
+  TimeReportSession const timeReportSession{};
+  std::unique_ptr<wasm::Module> const m = passes::loadWat(input);
+  runPipeline(m);
+  emit(m.get(), outputs);
+}
+
+void passes::runOnWasm(std::span<char const> input, OutputStreams const &outputs) {
+  applyThreads();
+  TimeReportSession const timeReportSession{};
+  // WasmBinaryReader only accepts std::vector as input.
+  std::unique_ptr<wasm::Module> const m = passes::loadWasm(std::vector<char>{input.begin(), input.end()});
+  runPipeline(m);
+  emit(m.get(), outputs);
+}
+
+std::string passes::runOnWatForTesting(std::string_view input, std::regex const &targetFunctionRegex) {
   std::unique_ptr<wasm::Module> m = passes::loadWat(input);
   wasm::PassRunner passRunner(m.get());
   if (EnableGCLoweringPassForTesting.get())
@@ -132,3 +283,36 @@ std::string passes::runOnWatForTesting(std::string const &input, std::regex cons
 }
 
 } // namespace warpo
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+
+namespace warpo::passes::ut {
+
+TEST(RunnerTest, LoadWasmKeepsFunctionNames) {
+  std::unique_ptr<wasm::Module> const m = loadWat(R"(
+      (module
+        (func $~lib/rt/__localtostack (param i32) (result i32)
+          local.get 0
+        )
+        (func $f (result i32)
+          i32.const 0
+          call $~lib/rt/__localtostack
+        )
+      )
+    )");
+  wasm::BufferWithRandomAccess buffer;
+  wasm::WasmBinaryWriter writer(m.get(), buffer, wasm::PassOptions::getWithoutOptimization());
+  writer.setNamesSection(true);
+  writer.write();
+  std::vector<char> const binary{buffer.begin(), buffer.end()};
+
+  std::unique_ptr<wasm::Module> const reloaded = loadWasm(binary);
+  EXPECT_NE(reloaded->getFunctionOrNull("~lib/rt/__localtostack"), nullptr);
+  EXPECT_NE(reloaded->getFunctionOrNull("f"), nullptr);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
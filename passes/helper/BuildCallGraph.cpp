@@ -1,33 +1,114 @@
+#include <memory>
 #include <set>
+#include <utility>
 
 #include "BuildCallGraph.hpp"
 #include "support/name.h"
+#include "wasm-traversal.h"
 #include "wasm.h"
 
 #define DEBUG_PREFIX "[CallGraph] "
 
 namespace warpo::passes {
 
-CallGraph CallGraphBuilder::createResults(wasm::Module &m) {
+CallGraph CallGraphBuilder::createResults(wasm::Module &m, IndirectCallTargets const &indirectCallTargets) {
   CallGraph ret{};
   for (std::unique_ptr<wasm::Function> const &f : m.functions) {
     // we treat imported function as leaf function because in wasm-compiler, nest wasm call is not allowed.
     ret.insert_or_assign(f->name, std::set<wasm::Name>{});
   }
+  std::set<wasm::Name> unknownCallees = indirectCallTargets.getUnknownTargets();
+  unknownCallees.insert(UnknownCallee);
+  ret.insert_or_assign(UnknownCallee, std::move(unknownCallees));
   return ret;
 }
 
+std::shared_ptr<IndirectCallTargets const> IndirectCallTargets::create(wasm::Module &m) {
+  struct TableChangeCollector : public wasm::PostWalker<TableChangeCollector> {
+    std::set<wasm::Name> changedTables_;
+    void visitTableSet(wasm::TableSet *expr) { changedTables_.insert(expr->table); }
+    void visitTableGrow(wasm::TableGrow *expr) { changedTables_.insert(expr->table); }
+    void visitTableFill(wasm::TableFill *expr) { changedTables_.insert(expr->table); }
+    void visitTableCopy(wasm::TableCopy *expr) { changedTables_.insert(expr->destTable); }
+    void visitTableInit(wasm::TableInit *expr) { changedTables_.insert(expr->table); }
+    std::set<wasm::Name> refFuncs_;
+    void visitRefFunc(wasm::RefFunc *expr) { refFuncs_.insert(expr->func); }
+  };
+  TableChangeCollector collector{};
+  for (std::unique_ptr<wasm::Function> const &f : m.functions) {
+    if (!f->imported())
+      collector.walk(f->body);
+  }
+  for (std::unique_ptr<wasm::Global> const &global : m.globals) {
+    if (!global->imported())
+      collector.walk(global->init);
+  }
+  std::set<wasm::Name> openTables = std::move(collector.changedTables_);
+  for (std::unique_ptr<wasm::Table> const &table : m.tables) {
+    if (table->imported())
+      openTables.insert(table->name);
+  }
+  for (std::unique_ptr<wasm::Export> const &e : m.exports) {
+    if (e->kind == wasm::ExternalKind::Table)
+      openTables.insert(e->value);
+  }
+
+  auto ret = std::make_shared<IndirectCallTargets>();
+  if (!openTables.empty()) {
+    // host can store exported functions into open tables, and the module can store functions from other tables or
+    // ref.func into them
+    ret->unknownTargets_ = std::move(collector.refFuncs_);
+    for (std::unique_ptr<wasm::Export> const &e : m.exports) {
+      if (e->kind == wasm::ExternalKind::Function)
+        ret->unknownTargets_.insert(e->value);
+    }
+    for (std::unique_ptr<wasm::ElementSegment> const &segment : m.elementSegments) {
+      for (wasm::Expression *item : segment->data) {
+        if (auto *const refFunc = item->dynCast<wasm::RefFunc>())
+          ret->unknownTargets_.insert(refFunc->func);
+      }
+    }
+  }
+  for (std::unique_ptr<wasm::Table> const &table : m.tables) {
+    if (!openTables.contains(table->name))
+      ret->closedTables_.insert_or_assign(table->name, std::vector<wasm::Name>{});
+  }
+  for (std::unique_ptr<wasm::ElementSegment> const &segment : m.elementSegments) {
+    auto const it = ret->closedTables_.find(segment->table);
+    if (it == ret->closedTables_.end())
+      continue;
+    for (wasm::Expression *item : segment->data) {
+      if (auto *const refFunc = item->dynCast<wasm::RefFunc>()) {
+        it->second.push_back(refFunc->func);
+      } else if (!item->is<wasm::RefNull>()) {
+        // e.g. global.get of imported funcref
+        ret->closedTables_.erase(it);
+        break;
+      }
+    }
+  }
+  return ret;
+}
+
+std::set<wasm::Name> IndirectCallTargets::get(wasm::Module &m, wasm::CallIndirect *expr) const {
+  auto const it = closedTables_.find(expr->table);
+  if (it == closedTables_.end())
+    return {UnknownCallee};
+  std::set<wasm::Name> targets{};
+  for (wasm::Name const &func : it->second) {
+    if (expr->heapType.getSignature() == m.getFunction(func)->getSig())
+      targets.insert(func);
+  }
+  if (targets.empty())
+    return {UnknownCallee};
+  return targets;
+}
+
 void CallGraphBuilder::visitCall(wasm::Call *expr) { cg_.at(getFunction()->name).insert(expr->target); }
 
 void CallGraphBuilder::visitCallIndirect(wasm::CallIndirect *expr) {
-  wasm::Module *m = getModule();
-  std::set<wasm::Name> &call = cg_.at(getFunction()->name);
-  std::vector<wasm::Expression *> const &potentialTargets = m->getElementSegment(expr->table)->data;
-  for (wasm::Expression *target : potentialTargets) {
-    wasm::Name refFunc = target->cast<wasm::RefFunc>()->func;
-    if (expr->heapType.getSignature() == m->getFunction(refFunc)->getSig())
-      call.insert(refFunc);
-  }
+  std::set<wasm::Name> const targets = indirectCallTargets_->get(*getModule(), expr);
+  cg_.at(getFunction()->name).insert(targets.begin(), targets.end());
 }
 
 } // namespace warpo::passes
@@ -38,6 +119,7 @@ void CallGraphBuilder::visitCallIndirect(wasm::CallIndirect *expr) {
 #include <gtest/gtest.h>
 
 #include "../Runner.hpp"
+#include "parser/wat-parser.h"
 
 namespace warpo::passes::ut {
 
@@ -68,9 +150,10 @@ TEST(BuildCallGraph, Base) {
       )
     )");
 
-  auto CG = CallGraphBuilder::createResults(*m);
+  std::shared_ptr<IndirectCallTargets const> const indirectCallTargets = IndirectCallTargets::create(*m);
+  auto CG = CallGraphBuilder::createResults(*m, *indirectCallTargets);
   wasm::PassRunner runner{m.get()};
-  runner.add(std::unique_ptr<wasm::Pass>{new CallGraphBuilder(CG)});
+  runner.add(std::unique_ptr<wasm::Pass>{new CallGraphBuilder(CG, indirectCallTargets)});
   runner.run();
 
   EXPECT_TRUE(CG.at("leaf").empty());
@@ -88,6 +171,38 @@ TEST(BuildCallGraph, Base) {
   EXPECT_THAT(CG.at("call_indirect_i"), Contains("leaf_i32"));
 }
 
+TEST(BuildCallGraph, ChangedTable) {
+  // table instructions need reference types which are not enabled by loadWat
+  wasm::Module m{};
+  m.features = wasm::FeatureSet::All;
+  auto parsed = wasm::WATParser::parseModule(m, R"(
+      (module
+        (type $v_v (func))
+        (table $closed 1 funcref)
+        (table $changed 1 funcref)
+        (elem $closed (table $closed) (i32.const 0) func $leaf)
+        (elem $changed (table $changed) (i32.const 0) func $leaf)
+        (func $leaf)
+        (func $set (table.set $changed (i32.const 0) (ref.func $set)))
+        (func $call_closed (call_indirect $closed (type $v_v) (i32.const 0)))
+        (func $call_changed (call_indirect $changed (type $v_v) (i32.const 0)))
+      )
+    )");
+  ASSERT_EQ(parsed.getErr(), nullptr);
+
+  std::shared_ptr<IndirectCallTargets const> const indirectCallTargets = IndirectCallTargets::create(m);
+  CallGraph CG = CallGraphBuilder::createResults(m, *indirectCallTargets);
+  wasm::PassRunner runner{&m};
+  runner.add(std::unique_ptr<wasm::Pass>{new CallGraphBuilder(CG, indirectCallTargets)});
+  runner.run();
+
+  EXPECT_EQ(CG.at("call_closed"), std::set<wasm::Name>{"leaf"});
+  EXPECT_EQ(CG.at("call_changed"), std::set<wasm::Name>{UnknownCallee});
+  // functions in element segments and ref.func may be stored into the changed table
+  EXPECT_THAT(CG.at(UnknownCallee), Contains("leaf"));
+  EXPECT_THAT(CG.at(UnknownCallee), Contains("set"));
+}
+
 } // namespace warpo::passes::ut
 
 #endif
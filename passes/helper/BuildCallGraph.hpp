@@ -3,6 +3,7 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "pass.h"
 #include "support/name.h"
@@ -10,26 +11,53 @@
 
 namespace warpo::passes {
 
+/// @brief callee of call_indirect whose targets cannot be resolved statically, it may be any function.
+/// @details it calls itself and every function in IndirectCallTargets::getUnknownTargets in call graph, so the depth
+/// of its callers is unbounded and functions it may call are never covered by their other callers.
+constexpr const char *UnknownCallee = "<unknown indirect callee>";
+
+/// @brief possible targets of call_indirect on each table.
+struct IndirectCallTargets {
+  static std::shared_ptr<IndirectCallTargets const> create(wasm::Module &m);
+  /// @brief signature-compatible functions in element segments of the table called by call_indirect.
+  /// @details it is {UnknownCallee} when the table is imported, exported or changed by table instructions, or when no
+  /// target is found.
+  std::set<wasm::Name> get(wasm::Module &m, wasm::CallIndirect *expr) const;
+  /// @brief functions which may be called by UnknownCallee, i.e. functions which may be stored in tables which are
+  /// not closed.
+  std::set<wasm::Name> const &getUnknownTargets() const { return unknownTargets_; }
+
+private:
+  /// @brief functions in element segments of tables which cannot be changed out of the module.
+  std::map<wasm::Name, std::vector<wasm::Name>> closedTables_{};
+  std::set<wasm::Name> unknownTargets_{};
+};
+
 using CallGraph = std::map<wasm::Name, std::set<wasm::Name>>;
 struct CallGraphBuilder : public wasm::WalkerPass<wasm::PostWalker<CallGraphBuilder>> {
-  static CallGraph createResults(wasm::Module &m);
+  static CallGraph createResults(wasm::Module &m, IndirectCallTargets const &indirectCallTargets);
 
-  explicit CallGraphBuilder(CallGraph &result) : cg_(result) {}
+  CallGraphBuilder(CallGraph &result, std::shared_ptr<IndirectCallTargets const> indirectCallTargets)
+      : cg_(result), indirectCallTargets_(std::move(indirectCallTargets)) {}
   bool isFunctionParallel() override { return true; }
-  std::unique_ptr<wasm::Pass> create() override { return std::make_unique<CallGraphBuilder>(cg_); }
+  std::unique_ptr<wasm::Pass> create() override {
+    return std::make_unique<CallGraphBuilder>(cg_, indirectCallTargets_);
+  }
   bool modifiesBinaryenIR() override { return false; }
 
   void visitCall(wasm::Call *expr);
   void visitCallIndirect(wasm::CallIndirect *expr);
 
-  static std::shared_ptr<CallGraph> addToPass(wasm::PassRunner &runner) {
-    auto cg = std::make_shared<CallGraph>(createResults(*runner.wasm));
-    runner.add(std::unique_ptr<wasm::Pass>(new CallGraphBuilder(*cg)));
+  static std::shared_ptr<CallGraph> addToPass(wasm::PassRunner &runner,
+                                              std::shared_ptr<IndirectCallTargets const> const &indirectCallTargets) {
+    auto cg = std::make_shared<CallGraph>(createResults(*runner.wasm, *indirectCallTargets));
+    runner.add(std::unique_ptr<wasm::Pass>(new CallGraphBuilder(*cg, indirectCallTargets)));
     return cg;
   }
 
 private:
   CallGraph &cg_;
+  std::shared_ptr<IndirectCallTargets const> indirectCallTargets_;
 };
 
 } // namespace warpo::passes
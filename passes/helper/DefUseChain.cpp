@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "CFG.hpp"
+#include "DefUseChain.hpp"
+#include "GenKillDataflow.hpp"
+#include "support/DynBitSet.hpp"
+#include "support/Range.hpp"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+namespace {
+
+template <class Expr, class Index> using SortedIndexes = std::vector<std::pair<Expr *, Index>>;
+
+template <class Expr, class Index> void sortIndexes(SortedIndexes<Expr, Index> &indexes) {
+  std::sort(indexes.begin(), indexes.end(),
+            [](auto const &lhs, auto const &rhs) -> bool { return std::less<Expr *>{}(lhs.first, rhs.first); });
+}
+
+template <class Expr, class Index>
+std::optional<Index> findIndex(SortedIndexes<Expr, Index> const &indexes, Expr *expr) {
+  auto const it = std::lower_bound(indexes.begin(), indexes.end(), expr, [](auto const &lhs, Expr *rhs) -> bool {
+    return std::less<Expr *>{}(lhs.first, rhs);
+  });
+  if (it == indexes.end() || it->first != expr)
+    return std::nullopt;
+  return it->second;
+}
+
+/// @brief forward analysis of reaching definitions, bit i means definition i may reach.
+class ReachingDefTransferFn : public IGenKillTransfer {
+  SortedIndexes<wasm::LocalSet, DefUseChain::DefIndex> const &defIndexes_;
+  std::vector<std::vector<DefUseChain::DefIndex>> const &defsOfLocal_;
+
+public:
+  /// @brief reaching definitions of each local.get in CFG order
+  std::vector<std::pair<wasm::LocalGet *, std::vector<DefUseChain::DefIndex>>> reaching_;
+
+  ReachingDefTransferFn(SortedIndexes<wasm::LocalSet, DefUseChain::DefIndex> const &defIndexes,
+                        std::vector<std::vector<DefUseChain::DefIndex>> const &defsOfLocal)
+      : defIndexes_(defIndexes), defsOfLocal_(defsOfLocal) {}
+
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    if (auto *set = expr->dynCast<wasm::LocalSet>()) {
+      for (DefUseChain::DefIndex const defIndex : defsOfLocal_[set->index])
+        effect.kill(defIndex);
+      effect.gen(findIndex(defIndexes_, set).value());
+    }
+  }
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    if (auto *get = expr->dynCast<wasm::LocalGet>()) {
+      std::vector<DefUseChain::DefIndex> defs{};
+      for (DefUseChain::DefIndex const defIndex : defsOfLocal_[get->index]) {
+        if (state.get(defIndex))
+          defs.push_back(defIndex);
+      }
+      reaching_.emplace_back(get, std::move(defs));
+    }
+  }
+};
+
+} // namespace
+
+DefUseChain DefUseChain::create(wasm::Function *func) { return create(func, CFG::fromFunction(func)); }
+
+DefUseChain DefUseChain::create(wasm::Function *func, CFG const &cfg) {
+  DefUseChain ret{};
+  wasm::Index const numLocals = func->getNumLocals();
+  std::vector<std::vector<DefIndex>> defsOfLocal(numLocals);
+  for (wasm::Index const localIndex : Range{numLocals}) {
+    ret.defs_.push_back(nullptr);
+    defsOfLocal[localIndex].push_back(static_cast<DefIndex>(localIndex));
+  }
+  for (BasicBlock const &bb : cfg) {
+    for (wasm::Expression *expr : bb) {
+      if (auto *set = expr->dynCast<wasm::LocalSet>()) {
+        DefIndex const defIndex = static_cast<DefIndex>(ret.defs_.size());
+        ret.defs_.push_back(set);
+        ret.defIndexes_.emplace_back(set, defIndex);
+        defsOfLocal[set->index].push_back(defIndex);
+      }
+    }
+  }
+
+  sortIndexes(ret.defIndexes_);
+
+  ReachingDefTransferFn transfer{ret.defIndexes_, defsOfLocal};
+  GenKillDataflow dataflow{cfg, ret.defs_.size(), DataflowDirection::Forward, transfer};
+  DynBitset boundary{ret.defs_.size()};
+  for (wasm::Index const localIndex : Range{numLocals})
+    boundary.set(localIndex, true);
+  dataflow.setBoundary(boundary);
+  dataflow.solve();
+  dataflow.collectResults();
+
+  std::vector<uint32_t> useCountOfDef(ret.defs_.size(), 0U);
+  ret.defsOfUseBegin_.push_back(0U);
+  for (auto const &[get, defs] : transfer.reaching_) {
+    ret.useIndexes_.emplace_back(get, static_cast<uint32_t>(ret.uses_.size()));
+    ret.uses_.push_back(get);
+    ret.defsOfUse_.insert(ret.defsOfUse_.end(), defs.begin(), defs.end());
+    ret.defsOfUseBegin_.push_back(static_cast<uint32_t>(ret.defsOfUse_.size()));
+    for (DefIndex const defIndex : defs)
+      useCountOfDef[defIndex]++;
+  }
+
+  sortIndexes(ret.useIndexes_);
+
+  ret.usesOfDefBegin_.push_back(0U);
+  for (uint32_t const count : useCountOfDef)
+    ret.usesOfDefBegin_.push_back(ret.usesOfDefBegin_.back() + count);
+  ret.usesOfDef_.resize(ret.usesOfDefBegin_.back(), nullptr);
+  std::vector<uint32_t> cursor{ret.usesOfDefBegin_.begin(), ret.usesOfDefBegin_.end() - 1};
+  for (size_t const useIndex : Range{ret.uses_.size()}) {
+    for (uint32_t i = ret.defsOfUseBegin_[useIndex]; i < ret.defsOfUseBegin_[useIndex + 1]; i++)
+      ret.usesOfDef_[cursor[ret.defsOfUse_[i]]++] = ret.uses_[useIndex];
+  }
+  return ret;
+}
+
+std::optional<DefUseChain::DefIndex> DefUseChain::getDefIndex(wasm::LocalSet *set) const {
+  return findIndex(defIndexes_, set);
+}
+
+std::span<DefUseChain::DefIndex const> DefUseChain::getReachingDefs(wasm::LocalGet *get) const {
+  std::optional<uint32_t> const found = findIndex(useIndexes_, get);
+  if (!found.has_value())
+    return {};
+  uint32_t const useIndex = found.value();
+  return std::span<DefIndex const>{defsOfUse_}.subspan(
+      defsOfUseBegin_[useIndex], defsOfUseBegin_[useIndex + 1] - defsOfUseBegin_[useIndex]);
+}
+
+std::span<wasm::LocalGet *const> DefUseChain::getUses(DefIndex defIndex) const {
+  return std::span<wasm::LocalGet *const>{usesOfDef_}.subspan(usesOfDefBegin_[defIndex],
+                                                               usesOfDefBegin_[defIndex + 1] - usesOfDefBegin_[defIndex]);
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "../Runner.hpp"
+#include "ir/find_all.h"
+
+namespace warpo::passes::ut {
+
+TEST(DefUseChainTest, IfElse) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (param i32) (local i32)
+        (if (local.get 0)
+          (then (local.set 1 (i32.const 1)))
+          (else (local.set 1 (i32.const 2)))
+        )
+        (drop (local.get 1))
+        (local.set 1 (i32.const 3))
+        (drop (local.get 1))
+      )
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  DefUseChain const chain = DefUseChain::create(f);
+  std::vector<wasm::LocalSet *> const sets = wasm::FindAll<wasm::LocalSet>{f->body}.list;
+  std::vector<wasm::LocalGet *> const gets = wasm::FindAll<wasm::LocalGet>{f->body}.list;
+  ASSERT_EQ(sets.size(), 3U);
+  ASSERT_EQ(gets.size(), 3U);
+  ASSERT_EQ(chain.getDefCount(), 5U);
+
+  std::span<DefUseChain::DefIndex const> const paramDefs = chain.getReachingDefs(gets[0]);
+  ASSERT_EQ(paramDefs.size(), 1U);
+  EXPECT_TRUE(chain.isEntryDef(paramDefs[0]));
+  EXPECT_EQ(paramDefs[0], 0U);
+
+  std::span<DefUseChain::DefIndex const> const mergedDefs = chain.getReachingDefs(gets[1]);
+  ASSERT_EQ(mergedDefs.size(), 2U);
+  EXPECT_EQ(chain.getDef(mergedDefs[0]), sets[0]);
+  EXPECT_EQ(chain.getDef(mergedDefs[1]), sets[1]);
+
+  std::span<DefUseChain::DefIndex const> const lastDefs = chain.getReachingDefs(gets[2]);
+  ASSERT_EQ(lastDefs.size(), 1U);
+  EXPECT_EQ(chain.getDef(lastDefs[0]), sets[2]);
+
+  // zero initialized var is never used
+  EXPECT_TRUE(chain.getUses(1U).empty());
+  std::span<wasm::LocalGet *const> const uses = chain.getUses(chain.getDefIndex(sets[0]).value());
+  ASSERT_EQ(uses.size(), 1U);
+  EXPECT_EQ(uses[0], gets[1]);
+}
+
+TEST(DefUseChainTest, Loop) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (local i32)
+        (loop $l
+          (drop (local.get 0))
+          (local.set 0 (i32.const 1))
+          (br_if $l (i32.const 1))
+        )
+      )
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  DefUseChain const chain = DefUseChain::create(f);
+  std::vector<wasm::LocalSet *> const sets = wasm::FindAll<wasm::LocalSet>{f->body}.list;
+  std::vector<wasm::LocalGet *> const gets = wasm::FindAll<wasm::LocalGet>{f->body}.list;
+  ASSERT_EQ(sets.size(), 1U);
+  ASSERT_EQ(gets.size(), 1U);
+
+  std::span<DefUseChain::DefIndex const> const defs = chain.getReachingDefs(gets[0]);
+  ASSERT_EQ(defs.size(), 2U);
+  EXPECT_TRUE(chain.isEntryDef(defs[0]));
+  EXPECT_EQ(chain.getDef(defs[1]), sets[0]);
+  EXPECT_EQ(chain.getUses(defs[1]).size(), 1U);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
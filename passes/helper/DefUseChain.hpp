@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "CFG.hpp"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+/// @brief reaching definitions of locals and def-use chains built from them.
+/// @details definitions are `local.set` and the implicit definition of each local at function entry, which is the
+/// parameter or the zero initialized var. Uses are `local.get`. Chains of both directions are stored as flat index
+/// lists, so memory grows with the number of def-use pairs instead of expressions times definitions.
+class DefUseChain {
+public:
+  using DefIndex = uint32_t;
+
+private:
+  /// @brief local.set of each definition, nullptr for entry definition. entry definition of local i has index i.
+  std::vector<wasm::LocalSet *> defs_;
+  /// @brief index of each local.set and local.get, sorted by expression for binary search.
+  std::vector<std::pair<wasm::LocalSet *, DefIndex>> defIndexes_;
+  std::vector<wasm::LocalGet *> uses_;
+  std::vector<std::pair<wasm::LocalGet *, uint32_t>> useIndexes_;
+  /// @brief reaching definitions of use i are `defsOfUse_[defsOfUseBegin_[i], defsOfUseBegin_[i + 1])`
+  std::vector<uint32_t> defsOfUseBegin_;
+  std::vector<DefIndex> defsOfUse_;
+  /// @brief uses of definition i are `usesOfDef_[usesOfDefBegin_[i], usesOfDefBegin_[i + 1])`
+  std::vector<uint32_t> usesOfDefBegin_;
+  std::vector<wasm::LocalGet *> usesOfDef_;
+
+  DefUseChain() = default;
+
+public:
+  static DefUseChain create(wasm::Function *func, CFG const &cfg);
+  static DefUseChain create(wasm::Function *func);
+
+  size_t getDefCount() const { return defs_.size(); }
+  /// @brief nullptr means entry definition of local `defIndex`
+  wasm::LocalSet *getDef(DefIndex defIndex) const { return defs_[defIndex]; }
+  bool isEntryDef(DefIndex defIndex) const { return defs_[defIndex] == nullptr; }
+  /// @brief index of definition of local.set which is reachable in CFG
+  std::optional<DefIndex> getDefIndex(wasm::LocalSet *set) const;
+
+  /// @brief definitions which may reach get, empty for unreachable get
+  std::span<DefIndex const> getReachingDefs(wasm::LocalGet *get) const;
+  /// @brief local.get which may read the value of definition
+  std::span<wasm::LocalGet *const> getUses(DefIndex defIndex) const;
+};
+
+} // namespace warpo::passes
@@ -0,0 +1,188 @@
+#include <cstddef>
+#include <vector>
+
+#include "CFG.hpp"
+#include "GenKillDataflow.hpp"
+#include "support/DynBitSet.hpp"
+#include "support/Range.hpp"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+void GenKill::gen(size_t index) {
+  if (state_ != nullptr) {
+    state_->set(index, true);
+    return;
+  }
+  gen_.set(index, true);
+}
+
+void GenKill::kill(size_t index) {
+  if (state_ != nullptr) {
+    state_->set(index, false);
+    return;
+  }
+  gen_.set(index, false);
+  kill_.set(index, true);
+}
+
+void GenKill::apply(DynBitset &state) const {
+  state.subtract(kill_);
+  state.unionWith(gen_);
+}
+
+GenKillDataflow::GenKillDataflow(CFG const &cfg, size_t size, DataflowDirection direction,
+                                 IGenKillTransfer &transfer)
+    : cfg_(cfg), size_(size), direction_(direction), transfer_(transfer), inputStates_(cfg.size(), DynBitset{size}) {}
+
+void GenKillDataflow::setBoundary(DynBitset const &boundary) {
+  for (BasicBlock const &bb : cfg_) {
+    if (direction_ == DataflowDirection::Forward ? bb.isEntry() : bb.isExit()) {
+      inputStates_[bb.getIndex()].unionWith(boundary);
+      return;
+    }
+  }
+}
+
+std::vector<BasicBlock const *> GenKillDataflow::getIterationOrder() const {
+  std::vector<BasicBlock const *> order = direction_ == DataflowDirection::Forward
+                                              ? cfg_.getReversePostOrder()
+                                              : cfg_.getReversePostOrderOnReverseGraph();
+  // blocks which are not reachable in analysis direction still need to be solved.
+  DynBitset visited{cfg_.size()};
+  for (BasicBlock const *bb : order)
+    visited.set(bb->getIndex(), true);
+  for (BasicBlock const &bb : cfg_) {
+    if (!visited.get(bb.getIndex()))
+      order.push_back(&bb);
+  }
+  return order;
+}
+
+template <class Fn> void GenKillDataflow::forEachExpr(BasicBlock const &bb, Fn &&fn) const {
+  if (direction_ == DataflowDirection::Forward) {
+    for (wasm::Expression *expr : bb)
+      fn(expr);
+  } else {
+    for (auto it = bb.rbegin(); it != bb.rend(); ++it)
+      fn(*it);
+  }
+}
+
+void GenKillDataflow::solve() {
+  std::vector<GenKill> blockEffects{};
+  blockEffects.reserve(cfg_.size());
+  for (BasicBlock const &bb : cfg_) {
+    GenKill &effect = blockEffects.emplace_back(size_);
+    forEachExpr(bb, [&](wasm::Expression *expr) { transfer_.transfer(expr, effect); });
+  }
+
+  std::vector<BasicBlock const *> const order = getIterationOrder();
+  DynBitset pending{order.size()};
+  std::vector<size_t> orderIndex(cfg_.size());
+  for (size_t const i : Range{order.size()}) {
+    pending.set(i, true);
+    orderIndex[order[i]->getIndex()] = i;
+  }
+  DynBitset outputState{size_};
+  while (pending.any()) {
+    for (size_t const i : Range{order.size()}) {
+      if (!pending.get(i))
+        continue;
+      pending.set(i, false);
+      BasicBlock const &bb = *order[i];
+      outputState = inputStates_[bb.getIndex()];
+      blockEffects[bb.getIndex()].apply(outputState);
+      for (BasicBlock const *dep : direction_ == DataflowDirection::Forward ? bb.succs() : bb.preds()) {
+        if (inputStates_[dep->getIndex()].unionWith(outputState))
+          pending.set(orderIndex[dep->getIndex()], true);
+      }
+    }
+  }
+}
+
+void GenKillDataflow::collectResults() {
+  DynBitset state{size_};
+  for (BasicBlock const &bb : cfg_) {
+    state = inputStates_[bb.getIndex()];
+    GenKill effect{state};
+    forEachExpr(bb, [&](wasm::Expression *expr) {
+      transfer_.beforeTransfer(expr, state);
+      transfer_.transfer(expr, effect);
+      transfer_.afterTransfer(expr, state);
+    });
+  }
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+
+#include "../Runner.hpp"
+
+namespace warpo::passes::ut {
+
+namespace {
+
+/// @brief reaching local.set of local 0, bit i means the i-th local.set in walking order.
+struct ReachingSets : public IGenKillTransfer {
+  std::map<wasm::Expression *, size_t> sets_;
+  std::map<wasm::Expression *, DynBitset> reachingGets_;
+  void transfer(wasm::Expression *expr, GenKill &effect) override {
+    if (!sets_.contains(expr))
+      return;
+    for (size_t const index : Range{sets_.size()})
+      effect.kill(index);
+    effect.gen(sets_.at(expr));
+  }
+  void beforeTransfer(wasm::Expression *expr, DynBitset const &state) override {
+    if (expr->is<wasm::LocalGet>())
+      reachingGets_.insert_or_assign(expr, state);
+  }
+};
+
+} // namespace
+
+TEST(GenKillDataflowTest, ForwardLoop) {
+  std::unique_ptr<wasm::Module> m = loadWat(R"(
+    (module
+      (func $f (param i32)
+        (local.set 0 (i32.const 0))
+        (loop $l
+          (drop (local.get 0))
+          (local.set 0 (i32.const 1))
+          (br_if $l (i32.const 1))
+        )
+        (drop (local.get 0))
+      )
+    )
+  )");
+  wasm::Function *f = m->getFunction("f");
+  CFG const cfg = CFG::fromFunction(f);
+  ReachingSets transfer{};
+  std::vector<wasm::LocalGet *> gets{};
+  for (BasicBlock const &bb : cfg) {
+    for (wasm::Expression *expr : bb) {
+      if (expr->is<wasm::LocalSet>())
+        transfer.sets_.insert_or_assign(expr, transfer.sets_.size());
+      if (auto *get = expr->dynCast<wasm::LocalGet>())
+        gets.push_back(get);
+    }
+  }
+  ASSERT_EQ(transfer.sets_.size(), 2U);
+  ASSERT_EQ(gets.size(), 2U);
+
+  GenKillDataflow dataflow{cfg, transfer.sets_.size(), DataflowDirection::Forward, transfer};
+  dataflow.solve();
+  dataflow.collectResults();
+  EXPECT_EQ(transfer.reachingGets_.at(gets[0]).toString(), "11");
+  EXPECT_EQ(transfer.reachingGets_.at(gets[1]).toString(), "01");
+}
+
+} // namespace warpo::passes::ut
+
+#endif
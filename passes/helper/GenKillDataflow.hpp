@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "CFG.hpp"
+#include "support/DynBitSet.hpp"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+enum class DataflowDirection { Forward, Backward };
+
+/// @brief effect of expressions on the dataflow state in the form of `(state - kill) | gen`.
+/// @details it either accumulates the effect of a sequence of expressions or applies each effect to a state directly.
+class GenKill {
+  DynBitset gen_;
+  DynBitset kill_;
+  DynBitset *state_;
+
+public:
+  explicit GenKill(size_t size) : gen_(size), kill_(size), state_(nullptr) {}
+  explicit GenKill(DynBitset &state) : gen_(0U), kill_(0U), state_(&state) {}
+
+  void gen(size_t index);
+  void kill(size_t index);
+  /// @brief apply the accumulated effect to state.
+  void apply(DynBitset &state) const;
+};
+
+/// @brief client of GenKillDataflow.
+struct IGenKillTransfer {
+  virtual ~IGenKillTransfer() = default;
+  /// @brief record the effect of expr, it must only depend on expr.
+  virtual void transfer(wasm::Expression *expr, GenKill &effect) = 0;
+  /// @brief state before the transfer of expr in analysis direction, only called when collecting results.
+  virtual void beforeTransfer(wasm::Expression *expr, DynBitset const &state) {}
+  /// @brief state after the transfer of expr in analysis direction, only called when collecting results.
+  virtual void afterTransfer(wasm::Expression *expr, DynBitset const &state) {}
+};
+
+/// @brief union based gen/kill dataflow solver on word parallel bitsets.
+/// @details the effect of each basic block is summarized once, then blocks are iterated in reverse post order (on the
+/// reverse graph for backward analysis) until fixpoint.
+class GenKillDataflow {
+  CFG const &cfg_;
+  size_t size_;
+  DataflowDirection direction_;
+  IGenKillTransfer &transfer_;
+  std::vector<DynBitset> inputStates_;
+
+  std::vector<BasicBlock const *> getIterationOrder() const;
+  template <class Fn> void forEachExpr(BasicBlock const &bb, Fn &&fn) const;
+
+public:
+  GenKillDataflow(CFG const &cfg, size_t size, DataflowDirection direction, IGenKillTransfer &transfer);
+
+  /// @brief state at function entry for forward analysis, or at function exit for backward analysis.
+  void setBoundary(DynBitset const &boundary);
+  void solve();
+  /// @brief replay the transfer on the solved states and report them to IGenKillTransfer.
+  void collectResults();
+};
+
+} // namespace warpo::passes
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "IncrementalValidator.hpp"
+#include "ir/hashed.h"
+#include "ir/utils.h"
+#include "pass.h"
+#include "support/hash.h"
+#include "wasm-validator.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+namespace {
+
+size_t hashModuleInterface(wasm::Module const &m) {
+  size_t digest = wasm::hash(m.functions.size());
+  for (std::unique_ptr<wasm::Function> const &f : m.functions) {
+    wasm::rehash(digest, f->name);
+    wasm::rehash(digest, f->type.getID());
+    wasm::rehash(digest, f->imported());
+  }
+  wasm::rehash(digest, m.globals.size());
+  for (std::unique_ptr<wasm::Global> const &g : m.globals) {
+    wasm::rehash(digest, g->name);
+    wasm::rehash(digest, g->type.getID());
+    wasm::rehash(digest, g->mutable_);
+  }
+  wasm::rehash(digest, m.memories.size());
+  for (std::unique_ptr<wasm::Memory> const &memory : m.memories) {
+    wasm::rehash(digest, memory->name);
+    wasm::rehash(digest, memory->is64());
+    wasm::rehash(digest, memory->shared);
+  }
+  wasm::rehash(digest, m.tables.size());
+  for (std::unique_ptr<wasm::Table> const &table : m.tables) {
+    wasm::rehash(digest, table->name);
+    wasm::rehash(digest, table->type.getID());
+  }
+  wasm::rehash(digest, m.elementSegments.size());
+  for (std::unique_ptr<wasm::ElementSegment> const &segment : m.elementSegments) {
+    wasm::rehash(digest, segment->name);
+    wasm::rehash(digest, segment->type.getID());
+  }
+  wasm::rehash(digest, m.dataSegments.size());
+  for (std::unique_ptr<wasm::DataSegment> const &segment : m.dataSegments)
+    wasm::rehash(digest, segment->name);
+  wasm::rehash(digest, m.tags.size());
+  for (std::unique_ptr<wasm::Tag> const &tag : m.tags)
+    wasm::rehash(digest, tag->name);
+  return digest;
+}
+
+struct ChangedFunctionValidator : public wasm::Pass {
+  std::map<wasm::Function *, size_t> const &oldHashes_;
+  std::map<wasm::Function *, size_t> &newHashes_;
+  bool const validateAll_;
+  std::atomic<bool> &valid_;
+  std::atomic<size_t> &validatedCount_;
+
+  ChangedFunctionValidator(std::map<wasm::Function *, size_t> const &oldHashes,
+                           std::map<wasm::Function *, size_t> &newHashes, bool validateAll, std::atomic<bool> &valid,
+                           std::atomic<size_t> &validatedCount)
+      : oldHashes_(oldHashes), newHashes_(newHashes), validateAll_(validateAll), valid_(valid),
+        validatedCount_(validatedCount) {
+    name = "ChangedFunctionValidator";
+  }
+  bool isFunctionParallel() override { return true; }
+  std::unique_ptr<Pass> create() override {
+    return std::make_unique<ChangedFunctionValidator>(oldHashes_, newHashes_, validateAll_, valid_, validatedCount_);
+  }
+  bool modifiesBinaryenIR() override { return false; }
+
+  void runOnFunction(wasm::Module *m, wasm::Function *func) override {
+    size_t const hash = wasm::FunctionHasher::flexibleHashFunction(func, wasm::ExpressionAnalyzer::nothingHasher);
+    // map shape is fixed before running, only values are modified in parallel
+    newHashes_.at(func) = hash;
+    auto const it = oldHashes_.find(func);
+    if (!validateAll_ && it != oldHashes_.end() && it->second == hash)
+      return;
+    validatedCount_.fetch_add(1U, std::memory_order_relaxed);
+    if (!wasm::WasmValidator{}.validate(func, *m, wasm::WasmValidator::Globally))
+      valid_.store(false, std::memory_order_relaxed);
+  }
+};
+
+} // namespace
+
+IncrementalValidator::IncrementalValidator(wasm::Module &m) : m_(m), hashes_{}, interfaceHash_(hashModuleInterface(m)) {
+  wasm::FunctionHasher::Map hashes = wasm::FunctionHasher::createMap(&m);
+  wasm::PassRunner runner{&m};
+  runner.add(std::make_unique<wasm::FunctionHasher>(&hashes));
+  runner.run();
+  hashes_ = std::move(hashes);
+}
+
+bool IncrementalValidator::validateChanged() {
+  size_t const interfaceHash = hashModuleInterface(m_);
+  std::map<wasm::Function *, size_t> newHashes{};
+  for (std::unique_ptr<wasm::Function> const &f : m_.functions)
+    newHashes.insert_or_assign(f.get(), 0U);
+
+  std::atomic<bool> valid{true};
+  std::atomic<size_t> validatedCount{0U};
+  wasm::PassRunner runner{&m_};
+  runner.add(std::make_unique<ChangedFunctionValidator>(hashes_, newHashes, interfaceHash != interfaceHash_, valid,
+                                                        validatedCount));
+  runner.run();
+
+  hashes_ = std::move(newHashes);
+  interfaceHash_ = interfaceHash;
+  lastValidatedCount_ = validatedCount.load();
+  return valid.load();
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+
+#include "../Runner.hpp"
+#include "wasm-builder.h"
+
+namespace warpo::passes::ut {
+
+TEST(IncrementalValidatorTest, OnlyChangedFunction) {
+  auto m = loadWat(R"(
+      (module
+        (func $a (result i32)
+          i32.const 0
+        )
+        (func $b (result i32)
+          i32.const 1
+        )
+      )
+    )");
+  IncrementalValidator validator{*m};
+  EXPECT_TRUE(validator.validateChanged());
+  EXPECT_EQ(validator.getLastValidatedCount(), 0U);
+
+  wasm::Builder builder{*m};
+  m->getFunction("a")->body = builder.makeConst(wasm::Literal{int32_t{2}});
+  EXPECT_TRUE(validator.validateChanged());
+  EXPECT_EQ(validator.getLastValidatedCount(), 1U);
+
+  m->getFunction("b")->body = builder.makeConst(wasm::Literal{int64_t{2}});
+  EXPECT_FALSE(validator.validateChanged());
+  EXPECT_EQ(validator.getLastValidatedCount(), 1U);
+}
+
+TEST(IncrementalValidatorTest, InterfaceChanged) {
+  auto m = loadWat(R"(
+      (module
+        (func $a (result i32)
+          i32.const 0
+        )
+        (func $b (result i32)
+          i32.const 1
+        )
+      )
+    )");
+  IncrementalValidator validator{*m};
+  wasm::Builder builder{*m};
+  m->addGlobal(builder.makeGlobal("g", wasm::Type::i32, builder.makeConst(wasm::Literal{int32_t{0}}),
+                                  wasm::Builder::Mutable));
+  EXPECT_TRUE(validator.validateChanged());
+  EXPECT_EQ(validator.getLastValidatedCount(), 2U);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+#include "wasm.h"
+
+namespace warpo::passes {
+
+/// @brief validate only functions which are changed since the last validation.
+/// @details functions are dirty when their hash changes. When the module interface (function signatures, globals,
+/// memories, tables, segments) changes, every function is dirty because validation of unchanged bodies depends on it.
+/// Module level checks are not covered, a full wasm::WasmValidator is still needed at the end of the pipeline.
+class IncrementalValidator {
+  wasm::Module &m_;
+  std::map<wasm::Function *, size_t> hashes_;
+  size_t interfaceHash_;
+  size_t lastValidatedCount_ = 0U;
+
+public:
+  /// @param m is a module which is already validated.
+  explicit IncrementalValidator(wasm::Module &m);
+
+  /// @brief validate dirty functions in parallel and reset dirty state.
+  bool validateChanged();
+
+  size_t getLastValidatedCount() const { return lastValidatedCount_; }
+};
+
+} // namespace warpo::passes
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "LargestFirstScheduler.hpp"
+#include "ir/utils.h"
+#include "pass.h"
+#include "support/threads.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+namespace {
+
+struct LargestFirstPass : public wasm::Pass {
+  std::unique_ptr<wasm::Pass> pass_;
+  FunctionCostEstimator estimator_;
+  LargestFirstPass(std::unique_ptr<wasm::Pass> pass, FunctionCostEstimator estimator)
+      : pass_(std::move(pass)), estimator_(std::move(estimator)) {
+    name = pass_->name;
+  }
+  bool modifiesBinaryenIR() override { return pass_->modifiesBinaryenIR(); }
+  bool requiresNonNullableLocalFixups() override { return pass_->requiresNonNullableLocalFixups(); }
+  bool addsEffects() override { return pass_->addsEffects(); }
+
+  void run(wasm::Module *m) override {
+    std::vector<std::pair<size_t, wasm::Function *>> works{};
+    for (std::unique_ptr<wasm::Function> const &f : m->functions) {
+      if (!f->imported())
+        works.emplace_back(estimator_(f.get()), f.get());
+    }
+    if (works.empty())
+      return;
+    std::stable_sort(works.begin(), works.end(), [](auto const &a, auto const &b) { return a.first > b.first; });
+
+    std::atomic<size_t> next{0U};
+    std::vector<std::function<wasm::ThreadWorkState()>> doWorkers{};
+    for (size_t i = 0; i < wasm::ThreadPool::get()->size(); i++) {
+      doWorkers.push_back([this, m, &works, &next]() -> wasm::ThreadWorkState {
+        size_t const index = next.fetch_add(1U);
+        if (index >= works.size())
+          return wasm::ThreadWorkState::Finished;
+        std::unique_ptr<wasm::Pass> const instance = pass_->create();
+        instance->setPassRunner(getPassRunner());
+        instance->runOnFunction(m, works[index].second);
+        return index + 1U == works.size() ? wasm::ThreadWorkState::Finished : wasm::ThreadWorkState::More;
+      });
+    }
+    wasm::ThreadPool::get()->work(doWorkers);
+  }
+};
+
+} // namespace
+
+size_t estimateCostByExpressionCount(wasm::Function *func) { return wasm::Measurer::measure(func->body); }
+
+void LargestFirstPassRunner::doAdd(std::unique_ptr<wasm::Pass> pass) {
+  if (pass->isFunctionParallel())
+    pass = std::make_unique<LargestFirstPass>(std::move(pass), estimator_);
+  TimedPassRunner::doAdd(std::move(pass));
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <mutex>
+
+#include "../Runner.hpp"
+
+namespace warpo::passes::ut {
+
+TEST(LargestFirstSchedulerTest, RunOnEveryFunction) {
+  auto m = loadWat(R"(
+      (module
+        (import "env" "imported" (func $imported))
+        (func $small
+          nop
+        )
+        (func $large (result i32)
+          (i32.add (i32.const 1) (i32.add (i32.const 2) (i32.const 3)))
+        )
+      )
+    )");
+  struct Recorder : public wasm::Pass {
+    std::shared_ptr<std::vector<wasm::Name>> visited_;
+    std::shared_ptr<std::mutex> mutex_;
+    Recorder(std::shared_ptr<std::vector<wasm::Name>> visited, std::shared_ptr<std::mutex> mutex)
+        : visited_(std::move(visited)), mutex_(std::move(mutex)) {
+      name = "Recorder";
+    }
+    bool isFunctionParallel() override { return true; }
+    bool modifiesBinaryenIR() override { return false; }
+    std::unique_ptr<Pass> create() override { return std::make_unique<Recorder>(visited_, mutex_); }
+    void runOnFunction(wasm::Module *, wasm::Function *func) override {
+      std::lock_guard<std::mutex> const lock{*mutex_};
+      visited_->push_back(func->name);
+    }
+  };
+  auto visited = std::make_shared<std::vector<wasm::Name>>();
+  LargestFirstPassRunner runner{m.get()};
+  runner.add(std::make_unique<Recorder>(visited, std::make_shared<std::mutex>()));
+  runner.run();
+
+  ASSERT_EQ(visited->size(), 2U);
+  EXPECT_NE(std::find(visited->begin(), visited->end(), wasm::Name{"small"}), visited->end());
+  EXPECT_NE(std::find(visited->begin(), visited->end(), wasm::Name{"large"}), visited->end());
+}
+
+} // namespace warpo::passes::ut
+
+#endif
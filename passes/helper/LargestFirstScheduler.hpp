@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "TimeReport.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+/// @brief estimated cost to run a function parallel pass on a function.
+using FunctionCostEstimator = std::function<size_t(wasm::Function *)>;
+
+/// @brief expression count of the function body.
+size_t estimateCostByExpressionCount(wasm::Function *func);
+
+/// @brief pass runner which runs each function parallel pass on functions ordered by estimated cost, largest first.
+/// @details binaryen hands out functions in module order, so a few huge functions near the end of the module leave a
+/// long single thread tail. Idle threads take the next largest function from the shared queue. Function parallel
+/// passes are not interleaved per function anymore.
+struct LargestFirstPassRunner : public TimedPassRunner {
+  using TimedPassRunner::TimedPassRunner;
+  void setCostEstimator(FunctionCostEstimator estimator) { estimator_ = std::move(estimator); }
+
+protected:
+  void doAdd(std::unique_ptr<wasm::Pass> pass) override;
+
+private:
+  FunctionCostEstimator estimator_ = estimateCostByExpressionCount;
+};
+
+} // namespace warpo::passes
@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <sys/resource.h>
+#include <utility>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+#include "TimeReport.hpp"
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+namespace {
+
+thread_local TimeReport *currentTimeReport = nullptr;
+
+double getWallSeconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief cpu time of the whole process, including worker threads of function parallel passes.
+double getCpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  auto const toSeconds = [](timeval const &t) -> double {
+    return static_cast<double>(t.tv_sec) + static_cast<double>(t.tv_usec) / 1e6;
+  };
+  return toSeconds(usage.ru_utime) + toSeconds(usage.ru_stime);
+}
+
+int64_t getResidentKiB() {
+#if defined(__APPLE__)
+  mach_task_basic_info info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+    return 0;
+  return static_cast<int64_t>(info.resident_size / 1024U);
+#else
+  std::ifstream statm{"/proc/self/statm"};
+  int64_t pages = 0;
+  int64_t residentPages = 0;
+  if (!(statm >> pages >> residentPages))
+    return 0;
+  return residentPages * static_cast<int64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+#endif
+}
+
+std::string escapeJson(std::string const &str) {
+  std::string ret{};
+  ret.reserve(str.size());
+  for (char const c : str) {
+    if (c == '"' || c == '\\')
+      ret.push_back('\\');
+    ret.push_back(c);
+  }
+  return ret;
+}
+
+/// @brief print records[begin, end) which are children of the same parent as json array.
+size_t printJsonChildren(std::ostream &os, std::vector<TimeRecord> const &records, size_t begin, size_t depth) {
+  os << "[";
+  size_t index = begin;
+  bool first = true;
+  while (index < records.size() && records[index].depth == depth) {
+    TimeRecord const &record = records[index];
+    if (!first)
+      os << ",";
+    first = false;
+    os << fmt::format(R"({{"name":"{}","wall":{:.6f},"cpu":{:.6f},"rssDeltaKiB":{},"children":)",
+                      escapeJson(record.name), record.wallSeconds, record.cpuSeconds, record.rssDeltaKiB);
+    index = printJsonChildren(os, records, index + 1, depth + 1);
+    os << "}";
+  }
+  os << "]";
+  return index;
+}
+
+struct TimedPass : public wasm::Pass {
+  std::unique_ptr<wasm::Pass> pass_;
+  explicit TimedPass(std::unique_ptr<wasm::Pass> pass) : pass_(std::move(pass)) { name = pass_->name; }
+  // after effects are handled by the nested runner
+  bool modifiesBinaryenIR() override { return false; }
+  void run(wasm::Module *m) override {
+    TimeReport::Scope const scope{name};
+    wasm::PassRunner runner{getPassRunner()};
+    runner.add(std::move(pass_));
+    runner.run();
+  }
+};
+
+} // namespace
+
+TimeReport *TimeReport::current() { return currentTimeReport; }
+void TimeReport::setCurrent(TimeReport *report) { currentTimeReport = report; }
+
+TimeReport::Scope::Scope(std::string name) : report_(current()), index_(0), wallBegin_(0), cpuBegin_(0), rssBeginKiB_(0) {
+  if (report_ == nullptr)
+    return;
+  index_ = report_->records_.size();
+  report_->records_.push_back(TimeRecord{
+      .name = std::move(name), .depth = report_->depth_, .wallSeconds = 0, .cpuSeconds = 0, .rssDeltaKiB = 0});
+  report_->depth_++;
+  rssBeginKiB_ = getResidentKiB();
+  cpuBegin_ = getCpuSeconds();
+  wallBegin_ = getWallSeconds();
+}
+
+TimeReport::Scope::~Scope() {
+  if (report_ == nullptr)
+    return;
+  TimeRecord &record = report_->records_[index_];
+  record.wallSeconds = getWallSeconds() - wallBegin_;
+  record.cpuSeconds = getCpuSeconds() - cpuBegin_;
+  record.rssDeltaKiB = getResidentKiB() - rssBeginKiB_;
+  report_->depth_--;
+}
+
+void TimeReport::print(std::ostream &os) const {
+  os << fmt::format("{:>10} {:>10} {:>12}  {}\n", "wall(s)", "cpu(s)", "rss(KiB)", "name");
+  for (TimeRecord const &record : records_) {
+    os << fmt::format("{:>10.4f} {:>10.4f} {:>+12}  {}{}\n", record.wallSeconds, record.cpuSeconds,
+                      record.rssDeltaKiB, std::string(record.depth * 2U, ' '), record.name);
+  }
+}
+
+void TimeReport::printJson(std::ostream &os) const {
+  printJsonChildren(os, records_, 0U, 0U);
+  os << "\n";
+}
+
+void TimedPassRunner::doAdd(std::unique_ptr<wasm::Pass> pass) {
+  if (TimeReport::current() == nullptr) {
+    wasm::PassRunner::doAdd(std::move(pass));
+    return;
+  }
+  wasm::PassRunner::doAdd(std::make_unique<TimedPass>(std::move(pass)));
+}
+
+} // namespace warpo::passes
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace warpo::passes::ut {
+
+TEST(TimeReportTest, Disabled) {
+  TimeReport::setCurrent(nullptr);
+  TimeReport::Scope const scope{"stage"};
+  EXPECT_EQ(TimeReport::current(), nullptr);
+}
+
+TEST(TimeReportTest, Nested) {
+  TimeReport report{};
+  TimeReport::setCurrent(&report);
+  {
+    TimeReport::Scope const stage{"stage"};
+    { TimeReport::Scope const pass1{"pass1"}; }
+    { TimeReport::Scope const pass2{"pass2"}; }
+  }
+  { TimeReport::Scope const validate{"validate"}; }
+  TimeReport::setCurrent(nullptr);
+
+  ASSERT_EQ(report.getRecords().size(), 4U);
+  EXPECT_EQ(report.getRecords()[0].depth, 0U);
+  EXPECT_EQ(report.getRecords()[1].depth, 1U);
+  EXPECT_EQ(report.getRecords()[2].depth, 1U);
+  EXPECT_EQ(report.getRecords()[3].depth, 0U);
+
+  std::stringstream ss{};
+  report.printJson(ss);
+  std::string const json = ss.str();
+  EXPECT_NE(json.find(R"("name":"stage")"), std::string::npos);
+  EXPECT_NE(json.find(R"("name":"pass2","wall":)"), std::string::npos);
+  EXPECT_EQ(json.find(R"("children":[{"name":"validate")"), std::string::npos);
+}
+
+} // namespace warpo::passes::ut
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "pass.h"
+#include "wasm.h"
+
+namespace warpo::passes {
+
+struct TimeRecord {
+  std::string name;
+  size_t depth;
+  double wallSeconds;
+  double cpuSeconds;
+  int64_t rssDeltaKiB;
+};
+
+/// @brief wall time, cpu time and resident memory change of pipeline stages and passes.
+class TimeReport {
+  std::vector<TimeRecord> records_;
+  size_t depth_ = 0;
+
+public:
+  /// @brief report which collects records on current thread, nullptr when time report is disabled.
+  static TimeReport *current();
+  static void setCurrent(TimeReport *report);
+
+  /// @brief RAII recorder, does nothing when time report is disabled.
+  class Scope {
+    TimeReport *report_;
+    size_t index_;
+    double wallBegin_;
+    double cpuBegin_;
+    int64_t rssBeginKiB_;
+
+  public:
+    explicit Scope(std::string name);
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+    ~Scope();
+  };
+
+  std::vector<TimeRecord> const &getRecords() const { return records_; }
+  void print(std::ostream &os) const;
+  void printJson(std::ostream &os) const;
+};
+
+/// @brief pass runner which records each added pass in the current time report.
+/// @details with time report enabled, every pass runs in full before the next one, so function parallel passes are
+/// not interleaved per function anymore.
+struct TimedPassRunner : public wasm::PassRunner {
+  using wasm::PassRunner::PassRunner;
+
+protected:
+  void doAdd(std::unique_ptr<wasm::Pass> pass) override;
+};
+
+} // namespace warpo::passes
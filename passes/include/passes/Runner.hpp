@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <ostream>
 #include <regex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace warpo::passes {
@@ -13,8 +16,16 @@ struct Output {
 };
 
 void init();
-Output runOnWat(std::string const &input);
+Output runOnWat(std::string_view input);
 
-std::string runOnWatForTesting(std::string const &input, std::regex const &targetFunctionRegex);
+/// @brief destinations of the optimized module, null stream means skip this format.
+struct OutputStreams {
+  std::ostream *wat = nullptr;
+  std::ostream *wasm = nullptr;
+};
+void runOnWat(std::string_view input, OutputStreams const &outputs);
+void runOnWasm(std::span<char const> input, OutputStreams const &outputs);
+
+std::string runOnWatForTesting(std::string_view input, std::regex const &targetFunctionRegex);
 
 } // namespace warpo::passes
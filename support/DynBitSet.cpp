@@ -101,6 +101,33 @@ DynBitset DynBitset::operator~() const {
   }
   return ret;
 }
+bool DynBitset::unionWith(DynBitset const &b) {
+  assert(bitSize_ == b.bitSize_);
+  Element changed = 0U;
+  for (size_t i = 0; i < data_.size(); ++i) {
+    changed |= b.data_[i] & ~data_[i];
+    data_[i] |= b.data_[i];
+  }
+  return changed != 0U;
+}
+DynBitset &DynBitset::subtract(DynBitset const &b) {
+  assert(bitSize_ == b.bitSize_);
+  for (size_t i = 0; i < data_.size(); ++i) {
+    data_[i] &= ~b.data_[i];
+  }
+  return *this;
+}
+void DynBitset::reset() {
+  for (Element &element : data_)
+    element = 0U;
+}
+bool DynBitset::any() const {
+  for (Element const element : data_) {
+    if (element != 0U)
+      return true;
+  }
+  return false;
+}
 
 } // namespace warpo
 
@@ -139,5 +166,25 @@ TEST(DynBitSetTest, Set) {
   EXPECT_EQ(v.toString(), expected);
 }
 
+TEST(DynBitSetTest, UnionWithAndSubtract) {
+  DynBitset a{DynBitset::block_size + 2};
+  DynBitset b{DynBitset::block_size + 2};
+  a.set(1, true);
+  b.set(1, true);
+  EXPECT_FALSE(a.unionWith(b));
+  b.set(DynBitset::block_size + 1, true);
+  EXPECT_TRUE(a.unionWith(b));
+  EXPECT_TRUE(a.get(DynBitset::block_size + 1));
+
+  std::vector<size_t> setBits{};
+  a.forEachSetBit([&setBits](size_t index) { setBits.push_back(index); });
+  EXPECT_EQ(setBits, (std::vector<size_t>{1, DynBitset::block_size + 1}));
+
+  a.subtract(b);
+  EXPECT_FALSE(a.any());
+  b.reset();
+  EXPECT_FALSE(b.any());
+}
+
 } // namespace warpo::ut
 #endif
@@ -0,0 +1,76 @@
+#include <cstddef>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "support/MappedFile.hpp"
+
+namespace warpo {
+
+std::optional<MappedFile> MappedFile::open(std::string const &path) {
+  int const fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  size_t const size = static_cast<size_t>(st.st_size);
+  if (size == 0U) {
+    // mmap does not accept zero length
+    ::close(fd);
+    return MappedFile{nullptr, 0U};
+  }
+  void *const data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return std::nullopt;
+  ::madvise(data, size, MADV_SEQUENTIAL);
+  return MappedFile{static_cast<char const *>(data), size};
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+
+} // namespace warpo
+
+#ifdef WARPO_ENABLE_UNIT_TESTS
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+
+namespace warpo::ut {
+
+TEST(MappedFileTest, Read) {
+  std::string const path = testing::TempDir() + "warpo_mapped_file_test.txt";
+  {
+    std::ofstream of{path, std::ios::out | std::ios::binary};
+    of << "(module)";
+  }
+  std::optional<MappedFile> const file = MappedFile::open(path);
+  ASSERT_TRUE(file.has_value());
+  EXPECT_EQ(file->view(), "(module)");
+  EXPECT_EQ(file->bytes().size(), 8U);
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, Empty) {
+  std::string const path = testing::TempDir() + "warpo_mapped_file_empty_test.txt";
+  { std::ofstream of{path, std::ios::out | std::ios::binary}; }
+  std::optional<MappedFile> const file = MappedFile::open(path);
+  ASSERT_TRUE(file.has_value());
+  EXPECT_TRUE(file->view().empty());
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, NotExist) { EXPECT_FALSE(MappedFile::open("/not/exist/warpo_mapped_file").has_value()); }
+
+} // namespace warpo::ut
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <bit>
 #include <cassert>
 #include <compare>
 #include <cstdint>
@@ -47,6 +48,21 @@ public:
   DynBitset operator&(DynBitset const &b) const;
   DynBitset &operator&=(DynBitset const &b);
   DynBitset operator~() const;
+
+  /// @brief this |= b, returns whether any bit is changed.
+  bool unionWith(DynBitset const &b);
+  /// @brief this &= ~b without allocation.
+  DynBitset &subtract(DynBitset const &b);
+  void reset();
+  bool any() const;
+
+  /// @brief call fn with the index of each set bit in ascending order.
+  template <class Fn> void forEachSetBit(Fn &&fn) const {
+    for (size_t i = 0; i < data_.size(); ++i) {
+      for (Element word = data_[i]; word != 0U; word &= word - 1U)
+        fn(i * block_size + static_cast<size_t>(std::countr_zero(word)));
+    }
+  }
 };
 
 } // namespace warpo
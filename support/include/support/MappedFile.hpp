@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace warpo {
+
+/// @brief read-only memory mapped file, the content is valid until the object is destroyed.
+class MappedFile {
+  char const *data_;
+  size_t size_;
+
+  MappedFile(char const *data, size_t size) : data_(data), size_(size) {}
+
+public:
+  static std::optional<MappedFile> open(std::string const &path);
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+  MappedFile(MappedFile &&other) noexcept : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0U;
+  }
+  MappedFile &operator=(MappedFile &&other) = delete;
+  ~MappedFile();
+
+  std::string_view view() const { return std::string_view{data_, size_}; }
+  std::span<char const> bytes() const { return std::span<char const>{data_, size_}; }
+};
+
+} // namespace warpo
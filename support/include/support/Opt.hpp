@@ -11,22 +11,28 @@ void registerCallback(std::function<void(argparse::ArgumentParser &)> &&fn);
 }
 
 template <typename T> struct Opt {
-  Opt(const char *name, std::function<void(argparse::Argument &)> &&fn) {
+  Opt(const char *name, std::function<void(argparse::Argument &)> &&fn) : name_(name) {
     detail::registerCallback([fn = std::move(fn), name, this](argparse::ArgumentParser &argparser) -> void {
+      parser_ = &argparser;
       fn(argparser.add_argument(name).store_into(v_));
     });
   }
-  Opt(const char *shortName, const char *longName, std::function<void(argparse::Argument &)> &&fn) {
+  Opt(const char *shortName, const char *longName, std::function<void(argparse::Argument &)> &&fn) : name_(longName) {
     detail::registerCallback(
         [fn = std::move(fn), shortName, longName, this](argparse::ArgumentParser &argparser) -> void {
+          parser_ = &argparser;
           fn(argparser.add_argument(shortName, longName).store_into(v_));
         });
   }
 
   T const &get() const { return v_; }
+  /// @brief whether the option appears in command line, useful for option with optional value.
+  bool isUsed() const { return parser_ != nullptr && parser_->is_used(name_); }
 
 private:
   T v_{};
+  const char *name_;
+  argparse::ArgumentParser const *parser_ = nullptr;
 };
 
 void init(argparse::ArgumentParser &program, int argc, char const *argv[]);
@@ -0,0 +1,99 @@
+#!/usr/bin/env bash
+
+set -e
+
+WARPO=${WARPO:-build/tools/optimizer/warpo}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# request is `u8 format | u32le size | module`, see tools/optimizer/Server.hpp
+byte() {
+  printf "\\$(printf %03o "$1")"
+}
+request() {
+  local size
+  size=$(wc -c <"$2")
+  byte "$1"
+  for shift in 0 8 16 24; do
+    byte $(((size >> shift) & 255))
+  done
+  cat "$2"
+}
+
+# response is `u8 status | u32le size | payload`, split it into response.<n> and status.<n>
+split_responses() {
+  local file=$1 total offset=0 n=0
+  total=$(wc -c <"$file")
+  while [ "$offset" -lt "$total" ]; do
+    set -- $(od -An -tu1 -j "$offset" -N 5 "$file")
+    local size=$(($2 | ($3 << 8) | ($4 << 16) | ($5 << 24)))
+    tail -c +$((offset + 6)) "$file" | head -c "$size" >"$TMP/response.$n"
+    echo "$1" >"$TMP/status.$n"
+    offset=$((offset + 5 + size))
+    n=$((n + 1))
+  done
+  echo "$n" >"$TMP/count"
+}
+expect_count() {
+  if [ "$(cat "$TMP/count")" != "$1" ]; then
+    echo "expected $1 responses, got $(cat "$TMP/count")"
+    exit 1
+  fi
+}
+expect_status() {
+  local status
+  status=$(cat "$TMP/status.$1")
+  if [ "$status" != "$2" ]; then
+    echo "response $1: expected status $2, got $status: $(cat "$TMP/response.$1")"
+    exit 1
+  fi
+}
+
+# GC lowering expects the shadow stack of AS modules
+cat >"$TMP/module.wat" <<'WAT'
+(module
+  (import "env" "__localtostack" (func $~lib/rt/__localtostack (param i32) (result i32)))
+  (import "env" "__tmptostack" (func $~lib/rt/__tmptostack (param i32) (result i32)))
+  (import "env" "new" (func $~lib/rt/itcms/__new (param i32 i32) (result i32)))
+  (import "env" "use" (func $use (param i32 i32)))
+  (memory 1)
+  (global $~lib/memory/__stack_pointer (mut i32) (i32.const 1024))
+  (global $~lib/memory/__data_end i32 (i32.const 8))
+  (func $main (export "main")
+    (call $use
+      (call $~lib/rt/__tmptostack (call $~lib/rt/itcms/__new (i32.const 4) (i32.const 0)))
+      (call $~lib/rt/itcms/__new (i32.const 4) (i32.const 0)))
+  )
+)
+WAT
+printf "(module" >"$TMP/invalid.wat"
+"$WARPO" --input "$TMP/module.wat" --output "$TMP/expected.wasm" --emit wasm >/dev/null
+
+echo "text requests"
+{
+  request 0 "$TMP/module.wat"
+  request 0 "$TMP/invalid.wat"
+  request 7 "$TMP/module.wat"
+  request 0 "$TMP/module.wat"
+} | "$WARPO" --server >"$TMP/responses"
+split_responses "$TMP/responses"
+expect_count 4
+expect_status 0 0
+cmp "$TMP/response.0" "$TMP/expected.wasm"
+# failed requests do not stop the server
+expect_status 1 1
+expect_status 2 1
+expect_status 3 0
+cmp "$TMP/response.3" "$TMP/expected.wasm"
+
+echo "binary requests"
+# the optimized module is lowered already, so it skips GC lowering
+"$WARPO" --input "$TMP/expected.wasm" --output "$TMP/expected.reoptimized.wasm" --emit wasm \
+  --pipeline "default(optimize=0,shrink=2)" >/dev/null
+request 1 "$TMP/expected.wasm" | "$WARPO" --server --pipeline "default(optimize=0,shrink=2)" >"$TMP/responses"
+split_responses "$TMP/responses"
+expect_count 1
+expect_status 0 0
+cmp "$TMP/response.0" "$TMP/expected.reoptimized.wasm"
+
+echo "success"
@@ -1,11 +1,30 @@
 import * as asc from "../../assemblyscript/dist/asc.js";
+import { mkdirSync, writeFileSync } from "node:fs";
+import { dirname, resolve } from "node:path";
 
-export async function runPreAsc(outputWast: string, restArgv: string[]) {
+/**
+ * @returns module in binary format, which is kept in memory instead of being written to disk. Other outputs of asc,
+ * e.g. bindings, are written to disk as usual.
+ */
+export async function runPreAsc(output: string, restArgv: string[]): Promise<Uint8Array> {
   console.log("AS compilation stage");
-  const apiResult = asc.main(["-t", outputWast, ...restArgv], {
+  // binary keeps custom sections for warpo, e.g. warpo.managed_params, which are lost in text format.
+  let wasm: Uint8Array | undefined = undefined;
+  const apiResult = asc.main(["-o", output, ...restArgv], {
     stdout: process.stdout,
     stderr: process.stderr,
+    writeFile(filename: string, contents: string | Uint8Array, baseDir: string) {
+      if (filename === output && contents instanceof Uint8Array) {
+        wasm = contents;
+        return;
+      }
+      const filePath = resolve(baseDir, filename);
+      mkdirSync(dirname(filePath), { recursive: true });
+      writeFileSync(filePath, contents);
+    },
   });
   const { error } = await apiResult;
   if (error) process.exit(1);
+  if (wasm === undefined) throw new Error("AS compilation did not produce binary output");
+  return wasm;
 }
@@ -4,8 +4,7 @@ import { env } from "node:process";
 import { platform } from "node:os";
 import { projectRoot } from "./project_root.js";
 
-export function runWarpo(inputWast: string, outputWasm: string): void {
-  console.log("WARPO optimization stage");
+function getWarpoPath(): string {
   let platformPath;
   if (platform() === "linux") {
     platformPath = "linux";
@@ -16,8 +15,15 @@ export function runWarpo(inputWast: string, outputWasm: string): void {
   }
   const warpoPath = join(projectRoot, "bin", platformPath, "warpo");
   execSync("chmod +x " + warpoPath);
-  execFileSync(warpoPath, ["-i", inputWast, "-o", outputWasm], {
+  return warpoPath;
+}
+
+/** optimize module in binary format, which is passed to warpo through stdin */
+export function runWarpo(wasm: Uint8Array, outputWasm: string): void {
+  console.log("WARPO optimization stage");
+  execFileSync(getWarpoPath(), ["-i", "-", "-o", outputWasm], {
     env,
-    stdio: "inherit",
+    input: wasm,
+    stdio: ["pipe", "inherit", "inherit"],
   });
 }
@@ -1,67 +1,282 @@
+#include <algorithm>
 #include <argparse/argparse.hpp>
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
 #include <fmt/format.h>
 #include <fstream>
 #include <ios>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "Server.hpp"
+#include "Stdout.hpp"
 #include "fmt/base.h"
 #include "passes/Runner.hpp"
+#include "support/MappedFile.hpp"
 #include "support/Opt.hpp"
 
 static warpo::cli::Opt<std::string> inputPath{
     "-i",
     "--input",
-    [](argparse::Argument &arg) -> void { arg.help("input file").required(); },
+    [](argparse::Argument &arg) -> void {
+      arg.help("input file, '-' to read wat or wasm from stdin, required without --server or --batch");
+    },
 };
 
 static warpo::cli::Opt<std::string> outputPath{
     "-o",
     "--output",
-    [](argparse::Argument &arg) -> void { arg.help("output file").required(); },
+    [](argparse::Argument &arg) -> void {
+      arg.help("output file, '-' to write the format selected by --emit to stdout, required without --server or --batch");
+    },
 };
 
-int main(int argc, char const *argv[]) {
-  using namespace warpo;
+static warpo::cli::Opt<std::string> emitKind{
+    "--emit",
+    [](argparse::Argument &arg) -> void {
+      arg.help("output format to emit").choices("wasm", "wat", "both").default_value(std::string{"both"});
+    },
+};
 
-  passes::init();
+static warpo::cli::Opt<bool> serverMode{
+    "--server",
+    [](argparse::Argument &arg) -> void {
+      arg.help("keep running and optimize modules received on stdin, see tools/optimizer/Server.hpp for the protocol")
+          .flag();
+    },
+};
 
-  argparse::ArgumentParser program("warpo");
-  cli::init(program, argc, argv);
+static warpo::cli::Opt<std::string> batchManifest{
+    "--batch",
+    [](argparse::Argument &arg) -> void {
+      arg.help("manifest file with one '<input> <output>' pair per line, modules are optimized concurrently");
+    },
+};
+
+static warpo::cli::Opt<uint32_t> batchJobs{
+    "--jobs",
+    [](argparse::Argument &arg) -> void {
+      arg.help("number of modules optimized concurrently in batch mode, default is the number of cores");
+    },
+};
+
+static constexpr std::string_view wasmMagic{"\0asm", 4U};
+
+static bool isSameFile(std::string const &a, std::string const &b) {
+  std::error_code ec{};
+  return std::filesystem::equivalent(a, b, ec);
+}
+
+static std::string readStdin() {
+  std::string content{};
+  std::array<char, 64U * 1024U> buffer{};
+  size_t size = 0U;
+  while ((size = std::fread(buffer.data(), 1U, buffer.size(), stdin)) > 0U)
+    content.append(buffer.data(), size);
+  return content;
+}
+
+namespace {
+struct Input {
+  std::optional<warpo::MappedFile> file;
+  /// @brief content when it is not mapped from file
+  std::string buffer;
+  bool isBinary = false;
+  std::string_view content() const { return file.has_value() ? file->view() : std::string_view{buffer}; }
+};
+} // namespace
+
+static std::optional<Input> readInput(std::string const &path) {
+  if (path == "-") {
+    Input input{.file = std::nullopt, .buffer = readStdin(), .isBinary = false};
+    // stdin has no file extension, binary input is recognized by its magic number.
+    input.isBinary = input.content().starts_with(wasmMagic);
+    return input;
+  }
+  bool const isBinary = path.ends_with("wasm");
+  if (!isBinary && !path.ends_with("wat") && !path.ends_with("wast")) {
+    fmt::println("ERROR: invalid file extension: {}, expected 'wat', 'wast' or 'wasm'", path);
+    return std::nullopt;
+  }
+  std::optional<warpo::MappedFile> file = warpo::MappedFile::open(path);
+  if (!file.has_value()) {
+    fmt::println("ERROR: failed to open file: {}", path);
+    return std::nullopt;
+  }
+  return Input{.file = std::move(file), .buffer = {}, .isBinary = isBinary};
+}
+
+static int optimize(Input const &input, warpo::passes::OutputStreams const &outputs) {
+  std::string_view const content = input.content();
+  try {
+    if (input.isBinary)
+      warpo::passes::runOnWasm(std::span<char const>{content.data(), content.size()}, outputs);
+    else
+      warpo::passes::runOnWat(content, outputs);
+  } catch (std::logic_error const &e) {
+    // invalid pipeline, invalid input or validation error
+    fmt::println("ERROR: {}", e.what());
+    return 1;
+  }
+  return 0;
+}
 
-  if (!inputPath.get().ends_with("wat") && !inputPath.get().ends_with("wast")) {
-    fmt::println("ERROR: invalid file extension: {}, expected 'wat' or 'wast'", inputPath.get());
+static int optimizeToStdout(Input const &input) {
+  if (emitKind.get() == "both") {
+    fmt::println("ERROR: only one of '--emit wasm' and '--emit wat' can be written to stdout");
     return 1;
   }
-  std::ifstream ifstream{inputPath.get(), std::ios::in};
-  if (!ifstream.good()) {
-    fmt::println("ERROR: failed to open file: {}", inputPath.get());
+  std::FILE *const out = warpo::reserveStdout();
+  if (out == nullptr) {
+    fmt::println(stderr, "ERROR: failed to reserve stdout for output");
     return 1;
   }
-  std::string input{std::istreambuf_iterator<char>{ifstream}, {}};
-  passes::Output output = passes::runOnWat(input);
+  std::stringstream result{};
+  warpo::passes::OutputStreams outputs{};
+  if (emitKind.get() == "wat")
+    outputs.wat = &result;
+  else
+    outputs.wasm = &result;
+  int const ret = optimize(input, outputs);
+  std::string const content = std::move(result).str();
+  std::fwrite(content.data(), 1U, content.size(), out);
+  std::fclose(out);
+  return ret;
+}
 
+static int optimizeToFile(Input &input, std::string const &inputPath, std::string const &outputPath) {
   std::string watPathStr{};
   std::string wasmPathStr{};
-  if (outputPath.get().ends_with("wat")) {
-    watPathStr = outputPath.get();
-    wasmPathStr = outputPath.get().substr(0, outputPath.get().size() - 3) + "wasm";
-  } else if (outputPath.get().ends_with("wasm")) {
-    watPathStr = outputPath.get().substr(0, outputPath.get().size() - 4) + "wat";
-    wasmPathStr = outputPath.get();
+  if (outputPath.ends_with("wat")) {
+    watPathStr = outputPath;
+    wasmPathStr = outputPath.substr(0, outputPath.size() - 3) + "wasm";
+  } else if (outputPath.ends_with("wasm")) {
+    watPathStr = outputPath.substr(0, outputPath.size() - 4) + "wat";
+    wasmPathStr = outputPath;
   } else {
-    fmt::println("ERROR: invalid file extension: {}", outputPath.get());
+    fmt::println("ERROR: invalid file extension: {}", outputPath);
     return 1;
   }
-  std::ofstream wasmOf{wasmPathStr, std::ios::binary | std::ios::out};
-  if (!wasmOf.good()) {
-    fmt::println("ERROR: failed to open file: {}", outputPath.get());
+  bool const emitWasm = emitKind.get() != "wat";
+  bool const emitWat = emitKind.get() != "wasm";
+
+  if (input.file.has_value() && (isSameFile(inputPath, wasmPathStr) || isSameFile(inputPath, watPathStr))) {
+    // opening the output would truncate the mapped input when optimizing in place.
+    input.buffer = std::string{input.file->view()};
+    input.file.reset();
+  }
+
+  std::ofstream wasmOf{};
+  std::ofstream watOf{};
+  warpo::passes::OutputStreams outputs{};
+  if (emitWasm) {
+    wasmOf.open(wasmPathStr, std::ios::binary | std::ios::out);
+    if (!wasmOf.good()) {
+      fmt::println("ERROR: failed to open file: {}", wasmPathStr);
+      return 1;
+    }
+    outputs.wasm = &wasmOf;
+  }
+  if (emitWat) {
+    watOf.open(watPathStr, std::ios::out);
+    if (!watOf.good()) {
+      fmt::println("ERROR: failed to open file: {}", watPathStr);
+      return 1;
+    }
+    outputs.wat = &watOf;
+  }
+
+  return optimize(input, outputs);
+}
+
+static int optimizeOne(std::string const &inputPath, std::string const &outputPath) {
+  std::optional<Input> input = readInput(inputPath);
+  if (!input.has_value())
+    return 1;
+  if (outputPath == "-")
+    return optimizeToStdout(input.value());
+  return optimizeToFile(input.value(), inputPath, outputPath);
+}
+
+/// @brief optimize each pair in manifest concurrently, each module still runs the same pipeline as a single run.
+static int runBatch(std::string const &manifestPath) {
+  std::ifstream manifest{manifestPath};
+  if (!manifest.good()) {
+    fmt::println("ERROR: failed to open file: {}", manifestPath);
     return 1;
   }
-  wasmOf.write(reinterpret_cast<char const *>(output.wasm.data()), static_cast<std::streamsize>(output.wasm.size()));
-  std::ofstream watOf{watPathStr, std::ios::out};
-  if (!watOf.good()) {
-    fmt::println("ERROR: failed to open file: {}", outputPath.get());
+  std::vector<std::pair<std::string, std::string>> jobs{};
+  std::string line{};
+  for (size_t lineNumber = 1U; std::getline(manifest, line); lineNumber++) {
+    std::string_view const content = std::string_view{line}.substr(0, line.find('#'));
+    std::istringstream ss{std::string{content}};
+    std::string input{};
+    std::string output{};
+    if (!(ss >> input))
+      continue;
+    std::string extra{};
+    if (!(ss >> output) || (ss >> extra) || input == "-" || output == "-") {
+      fmt::println("ERROR: {}:{}: expected '<input> <output>'", manifestPath, lineNumber);
+      return 1;
+    }
+    jobs.emplace_back(std::move(input), std::move(output));
+  }
+
+  size_t const jobCount = batchJobs.get() != 0U ? batchJobs.get() : std::max(1U, std::thread::hardware_concurrency());
+  std::atomic<size_t> next{0U};
+  std::atomic<bool> failed{false};
+  auto const worker = [&]() -> void {
+    for (size_t index = next.fetch_add(1U); index < jobs.size(); index = next.fetch_add(1U)) {
+      auto const &[input, output] = jobs[index];
+      try {
+        if (optimizeOne(input, output) != 0)
+          failed.store(true);
+      } catch (std::exception const &e) {
+        fmt::println("ERROR: {}: {}", input, e.what());
+        failed.store(true);
+      } catch (...) {
+        fmt::println("ERROR: {}: unknown error", input);
+        failed.store(true);
+      }
+    }
+  };
+  std::vector<std::thread> threads{};
+  for (size_t i = 1U; i < std::min(jobCount, jobs.size()); i++)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread &thread : threads)
+    thread.join();
+  return failed.load() ? 1 : 0;
+}
+
+int main(int argc, char const *argv[]) {
+  using namespace warpo;
+
+  passes::init();
+
+  argparse::ArgumentParser program("warpo");
+  cli::init(program, argc, argv);
+
+  if (serverMode.get())
+    return runServer();
+  if (!batchManifest.get().empty())
+    return runBatch(batchManifest.get());
+  if (inputPath.get().empty() || outputPath.get().empty()) {
+    fmt::println("ERROR: --input and --output are required");
     return 1;
   }
-  watOf.write(output.wat.data(), static_cast<std::streamsize>(output.wat.size()));
+  return optimizeOne(inputPath.get(), outputPath.get());
 }
@@ -0,0 +1,98 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fmt/base.h>
+#include <fmt/format.h>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Server.hpp"
+#include "Stdout.hpp"
+#include "passes/Runner.hpp"
+
+namespace warpo {
+
+namespace {
+
+enum class InputFormat : uint8_t { Wat = 0U, Wasm = 1U };
+enum class Status : uint8_t { Ok = 0U, Error = 1U };
+
+constexpr size_t headerSize = 5U;
+
+void writeResponse(std::FILE *out, Status status, std::string_view payload) {
+  uint32_t const size = static_cast<uint32_t>(payload.size());
+  std::array<uint8_t, headerSize> const header{
+      static_cast<uint8_t>(status),      static_cast<uint8_t>(size),         static_cast<uint8_t>(size >> 8U),
+      static_cast<uint8_t>(size >> 16U), static_cast<uint8_t>(size >> 24U),
+  };
+  std::fwrite(header.data(), 1U, header.size(), out);
+  std::fwrite(payload.data(), 1U, payload.size(), out);
+  std::fflush(out);
+}
+
+std::string optimize(uint8_t format, std::span<char const> input) {
+  std::stringstream wasm{};
+  passes::OutputStreams const outputs{.wat = nullptr, .wasm = &wasm};
+  switch (static_cast<InputFormat>(format)) {
+  case InputFormat::Wat:
+    passes::runOnWat(std::string_view{input.data(), input.size()}, outputs);
+    break;
+  case InputFormat::Wasm:
+    passes::runOnWasm(input, outputs);
+    break;
+  default:
+    throw std::invalid_argument{fmt::format("unknown input format: {}", format)};
+  }
+  return std::move(wasm).str();
+}
+
+} // namespace
+
+int runServer() {
+  std::FILE *const out = reserveStdout();
+  if (out == nullptr) {
+    fmt::println(stderr, "ERROR: failed to reserve stdout for responses");
+    return 1;
+  }
+
+  std::vector<char> input{};
+  while (true) {
+    std::array<uint8_t, headerSize> header{};
+    size_t const readSize = std::fread(header.data(), 1U, header.size(), stdin);
+    if (readSize == 0U && std::feof(stdin) != 0)
+      break;
+    if (readSize != header.size()) {
+      fmt::println(stderr, "ERROR: truncated request header");
+      return 1;
+    }
+    uint32_t const size = static_cast<uint32_t>(header[1]) | (static_cast<uint32_t>(header[2]) << 8U) |
+                          (static_cast<uint32_t>(header[3]) << 16U) | (static_cast<uint32_t>(header[4]) << 24U);
+    input.resize(size);
+    if (std::fread(input.data(), 1U, input.size(), stdin) != input.size()) {
+      fmt::println(stderr, "ERROR: truncated request body");
+      return 1;
+    }
+
+    std::string result{};
+    try {
+      result = optimize(header[0], input);
+    } catch (std::exception const &e) {
+      writeResponse(out, Status::Error, e.what());
+      continue;
+    } catch (...) {
+      writeResponse(out, Status::Error, "unknown error");
+      continue;
+    }
+    writeResponse(out, Status::Ok, result);
+  }
+  std::fclose(out);
+  return 0;
+}
+
+} // namespace warpo
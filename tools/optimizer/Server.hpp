@@ -0,0 +1,12 @@
+#pragma once
+
+namespace warpo {
+
+/// @brief optimize modules received on stdin until EOF and write the results to stdout.
+/// @details each request is `u8 format (0: wat, 1: wasm) | u32le size | module`,
+/// each response is `u8 status (0: ok, 1: error) | u32le size | optimized wasm or error message`.
+/// The cost model and binaryen thread pool are created once and shared by all requests.
+/// @return exit code of the process.
+int runServer();
+
+} // namespace warpo
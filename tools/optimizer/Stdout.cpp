@@ -0,0 +1,16 @@
+#include <cstdio>
+#include <unistd.h>
+
+#include "Stdout.hpp"
+
+std::FILE *warpo::reserveStdout() {
+  std::fflush(stdout);
+  int const fd = dup(STDOUT_FILENO);
+  if (fd < 0)
+    return nullptr;
+  if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    close(fd);
+    return nullptr;
+  }
+  return fdopen(fd, "wb");
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdio>
+
+namespace warpo {
+
+/// @brief reserve stdout for the optimized module, anything else printed to stdout goes to stderr afterwards.
+/// @details debug output of passes is printed to stdout and would corrupt the module otherwise.
+/// @return stream of the original stdout, nullptr when failed.
+std::FILE *reserveStdout();
+
+} // namespace warpo
@@ -5,10 +5,12 @@
 #include <fmt/format.h>
 #include <fstream>
 #include <ios>
+#include <optional>
 #include <regex>
 #include <string>
 
 #include "passes/Runner.hpp"
+#include "support/MappedFile.hpp"
 #include "support/Opt.hpp"
 
 static warpo::cli::Opt<std::string> inputPath{
@@ -38,14 +40,13 @@ int main(int argc, char const *argv[]) {
     fmt::print(stderr, "ERROR: {}\n", e.what());
     return 1;
   }
-  std::ifstream ifstream{inputPath.get(), std::ios::in};
-  if (!ifstream.good()) {
+  std::optional<MappedFile> const input = MappedFile::open(inputPath.get());
+  if (!input.has_value()) {
     fmt::println("ERROR: failed to open file: {}", inputPath.get());
     return 1;
   }
-  std::string input{std::istreambuf_iterator<char>{ifstream}, {}};
 
-  std::string wat = passes::runOnWatForTesting(input, std::regex{functionRegex.get()});
+  std::string wat = passes::runOnWatForTesting(input->view(), std::regex{functionRegex.get()});
 
   std::ofstream watOf{outputPath.get(), std::ios::out};
   if (!watOf.good()) {